@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "cmakeclient.h"
+
+#include <QTest>
+
+namespace {
+
+QByteArray idleReply()
+{
+  return "{\"progress\":\"idle\",\"binary_dir\":\"/build\","
+         "\"source_dir\":\"/src\",\"project_name\":\"test\"}";
+}
+
+QByteArray targetName(int i)
+{
+  return "target" + QByteArray::number(i);
+}
+
+QByteArray targetInfoReply(int i)
+{
+  return "{\"target_info\":{\"target_name\":\"" + targetName(i)
+      + "\",\"object_sources\":[\"" + targetName(i) + ".cpp\"]}}";
+}
+
+}
+
+class CMakeClientTest : public QObject
+{
+  Q_OBJECT
+private Q_SLOTS:
+  void reconfigureThenRequestAgain();
+};
+
+// After a reconfigure the consumer cancels what it asked before and asks
+// again; the new requests must be answered although the old ones are
+// still queued behind the bulk in-flight limit.
+void CMakeClientTest::reconfigureThenRequestAgain()
+{
+  const int count = 5;
+  CMakeClient client;
+  client.startOffline();
+  client.replayReply(idleReply());
+  QCOMPARE(client.GetState(), CMakeClient::Idle);
+
+  QVector<QFuture<CMakeTargetInfo> > old;
+  for (int i = 0; i < count; ++i)
+    {
+      old.append(client.retrieveSources(QString::fromLatin1(targetName(i))));
+    }
+
+  auto generation = client.generation();
+  client.replayReply("{\"progress\":\"configuring\"}");
+  client.replayReply(idleReply());
+  QCOMPARE(client.generation(), generation + 1);
+
+  QVector<QFuture<CMakeTargetInfo> > renewed;
+  for (int i = 0; i < count; ++i)
+    {
+      old[i].cancel();
+      renewed.append(
+            client.retrieveSources(QString::fromLatin1(targetName(i))));
+    }
+
+  // The two written before the reconfigure are answered first, and
+  // dropped as stale; then the renewed requests, in order.
+  client.replayReply(targetInfoReply(0));
+  client.replayReply(targetInfoReply(1));
+  for (int i = 0; i < count; ++i)
+    {
+      client.replayReply(targetInfoReply(i));
+    }
+
+  for (int i = 0; i < count; ++i)
+    {
+      QVERIFY(old.at(i).isCanceled());
+      QVERIFY(renewed.at(i).isFinished());
+      QVERIFY(!renewed.at(i).isCanceled());
+      QCOMPARE(renewed.at(i).resultCount(), 1);
+      QCOMPARE(renewed.at(i).result().Name,
+               QString::fromLatin1(targetName(i)));
+      QCOMPARE(renewed.at(i).result().Sources,
+               QStringList(QString::fromLatin1(targetName(i) + ".cpp")));
+    }
+  QCOMPARE(client.pendingRequests(), 0);
+}
+
+QTEST_GUILESS_MAIN(CMakeClientTest)
+
+#include "cmakeclienttest.moc"
@@ -0,0 +1,664 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+// Runs batches of daemon queries against a build directory without a GUI
+// and streams the results to stdout as newline-delimited JSON.
+//
+// The script is read from --script or stdin, one query per line:
+//
+//   buildsystem
+//   target_info <target>
+//   target_info *                  every target of the last buildsystem
+//   content <file> <line>
+//   parse <file>
+//
+// Blank lines and lines starting with '#' are ignored.  Up to --depth
+// queries are kept in flight at once.  With --replay the queries are
+// answered, in order, by the replies of a protocol recording.
+//
+// The exit code is 1 if a query was invalid, 2 on --timeout, and 3 if the
+// recording ran out of replies before every query was answered.
+//
+// --bench-requests times the serialization of 1 MB code_complete requests
+// with QJsonDocument, as the client used to, against JsonWriter.
+//
+// --bulk has large replies handed over in shared memory rather than the
+// pipe, by daemons which support it such as cmakekate-mockdaemon.
+
+#include "cmakeclient.h"
+#include "futures.h"
+#include "jsonwriter.h"
+#include "protocolreplay.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QQueue>
+#include <QTimer>
+
+#include <cstdio>
+#include <limits>
+
+namespace {
+
+QJsonArray toJsonArray(const QStringList& list)
+{
+  QJsonArray array;
+  for (auto const& s : list)
+    {
+      array.append(s);
+    }
+  return array;
+}
+
+QJsonArray toJsonArray(const QJsonValue& first, const QJsonValue& second)
+{
+  QJsonArray array;
+  array.append(first);
+  array.append(second);
+  return array;
+}
+
+QJsonObject toJsonObject(const QMap<QString, QString>& map)
+{
+  QJsonObject obj;
+  for (auto it = map.constBegin(); it != map.constEnd(); ++it)
+    {
+      obj[it.key()] = it.value();
+    }
+  return obj;
+}
+
+// The request framing, as written by CMakeClient.
+const char frameStart[] = "\n[== CMake MetaMagic ==[\n";
+const char frameEnd[] = "\n]== CMake MetaMagic ==]\n";
+
+int benchRequests(int iterations)
+{
+  iterations = qMax(iterations, 1);
+
+  // A megabyte of CMake code with the quotes, tabs and non-ASCII text
+  // which have to be escaped or encoded.
+  const QString line = QStringLiteral(
+        "set(SRCS \"main.cpp\" \"g\u00fcnstig.cpp\")\t# \u2192 sources\n");
+  QString content;
+  content.reserve(1024 * 1024 + line.size());
+  while (content.size() < 1024 * 1024)
+    {
+      content += line;
+    }
+  const QString path = QStringLiteral("/src/project/CMakeLists.txt");
+
+  QElapsedTimer timer;
+  QByteArray viaDocument;
+  timer.start();
+  for (int i = 0; i < iterations; ++i)
+    {
+      QJsonObject obj;
+      obj["type"] = QStringLiteral("code_complete");
+      obj["file_path"] = path;
+      obj["file_line"] = 1000;
+      obj["file_column"] = 12;
+      obj["file_content"] = content;
+      QByteArray request;
+      request += frameStart;
+      request += QJsonDocument(obj).toJson();
+      request += frameEnd;
+      viaDocument = request;
+    }
+  auto documentNs = timer.nsecsElapsed();
+
+  JsonWriter writer;
+  QByteArray viaWriter;
+  timer.restart();
+  for (int i = 0; i < iterations; ++i)
+    {
+      writer.clear();
+      writer.appendRaw(frameStart, sizeof(frameStart) - 1);
+      writer.beginObject();
+      writer.field(QLatin1String("type"), QLatin1String("code_complete"));
+      writer.field(QLatin1String("file_path"), path);
+      writer.field(QLatin1String("file_line"), 1000);
+      writer.field(QLatin1String("file_column"), 12);
+      writer.field(QLatin1String("file_content"), content);
+      writer.endObject();
+      writer.appendRaw(frameEnd, sizeof(frameEnd) - 1);
+      viaWriter = QByteArray(writer.data().constData(), writer.data().size());
+    }
+  auto writerNs = timer.nsecsElapsed();
+
+  auto unframe = [](const QByteArray& frame) {
+      return QJsonDocument::fromJson(
+            frame.mid(sizeof(frameStart) - 1,
+                      frame.size() - sizeof(frameStart) - sizeof(frameEnd) + 2))
+          .object();
+    };
+
+  QJsonObject result;
+  result["iterations"] = iterations;
+  result["content_chars"] = content.size();
+  result["document_bytes"] = viaDocument.size();
+  result["writer_bytes"] = viaWriter.size();
+  result["document_us_per_request"] = double(documentNs) / iterations / 1000;
+  result["writer_us_per_request"] = double(writerNs) / iterations / 1000;
+  result["equivalent"] = unframe(viaDocument) == unframe(viaWriter);
+  QByteArray out = QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n';
+  fputs(out.constData(), stdout);
+  return result["equivalent"].toBool() ? 0 : 1;
+}
+
+}
+
+class BatchRunner : public QObject
+{
+  Q_OBJECT
+public:
+  BatchRunner(CMakeClient* client, const QStringList& script, int depth);
+
+  void start();
+  bool isFinished() const;
+  // Ends the batch, reporting the queries not answered yet as errors.
+  void abandon(const QString& reason);
+
+Q_SIGNALS:
+  void finished(int exitCode);
+
+private:
+  struct Query
+  {
+    int id;
+    QString type;
+    QStringList args;
+    qint64 sentAt;
+    qint64 answeredAt;
+    bool answered;
+    QJsonObject result;
+    QString error;
+  };
+
+  void pump();
+  bool send(Query& query);
+  // Answers the query from its own future once that finishes; a future
+  // without a result, such as one failed by the daemon, is an error.
+  template <typename T, typename F>
+  void answerFrom(int id, const QFuture<T>& future, F toJson);
+  void answer(int id, const QJsonObject& result, const QString& error);
+  void emitResult(const Query& query);
+  void emitError(const Query& query, const QString& error);
+
+private:
+  CMakeClient* mClient;
+  QQueue<Query> mScript;
+  // Sent queries in script order; answers are written in that order.
+  QQueue<Query> mInFlight;
+  int mDepth;
+  int mNextId = 0;
+  int mSeq = 0;
+  bool mFinished = false;
+  int mExitCode = 0;
+  QStringList mTargets;
+  QElapsedTimer mClock;
+  QFile mOut;
+};
+
+BatchRunner::BatchRunner(CMakeClient* client, const QStringList& script,
+                         int depth)
+  : mClient(client), mDepth(depth)
+{
+  mOut.open(stdout, QIODevice::WriteOnly);
+
+  for (auto const& line : script)
+    {
+      auto trimmed = line.trimmed();
+      if (trimmed.isEmpty() || trimmed.startsWith(QLatin1Char('#')))
+        {
+          continue;
+        }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+      auto words = trimmed.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+#else
+      auto words = trimmed.split(QLatin1Char(' '), QString::SkipEmptyParts);
+#endif
+      Query query;
+      query.id = 0;
+      query.type = words.takeFirst();
+      query.args = words;
+      query.sentAt = 0;
+      query.answeredAt = 0;
+      query.answered = false;
+      mScript.enqueue(query);
+    }
+
+  connect(mClient, &CMakeClient::stateChanged, this, [this] {
+      if (mClient->GetState() == CMakeClient::Idle)
+        {
+          pump();
+        }
+    });
+}
+
+void BatchRunner::start()
+{
+  mClock.start();
+  pump();
+}
+
+bool BatchRunner::isFinished() const
+{
+  return mFinished;
+}
+
+void BatchRunner::abandon(const QString& reason)
+{
+  if (mFinished)
+    {
+      return;
+    }
+  for (auto const& query : mInFlight)
+    {
+      if (!query.answered)
+        {
+          emitError(query, reason);
+        }
+      else if (!query.error.isEmpty())
+        {
+          emitError(query, query.error);
+        }
+      else
+        {
+          emitResult(query);
+        }
+    }
+  for (auto const& query : mScript)
+    {
+      emitError(query, reason);
+    }
+  mInFlight.clear();
+  mScript.clear();
+  mOut.flush();
+  mFinished = true;
+  Q_EMIT finished(3);
+}
+
+template <typename T, typename F>
+void BatchRunner::answerFrom(int id, const QFuture<T>& future, F toJson)
+{
+  onFinished(future, this, [this, id, toJson](const QFuture<T>& done) {
+      if (done.isCanceled() || done.resultCount() == 0)
+        {
+          answer(id, QJsonObject(), QStringLiteral("no result"));
+          return;
+        }
+      answer(id, toJson(done.result()), QString());
+    });
+}
+
+bool BatchRunner::send(Query& query)
+{
+  query.id = ++mNextId;
+  query.sentAt = mClock.nsecsElapsed();
+  if (query.type == QLatin1String("buildsystem"))
+    {
+      answerFrom(query.id, mClient->retrieveTargets(),
+                 [this](const CMakeBuildsystem& buildsystem) {
+          mTargets.clear();
+          QJsonArray jsTargets;
+          for (auto const& tgt : buildsystem.Targets)
+            {
+              mTargets.push_back(tgt.Name);
+              QJsonObject jsTgt;
+              jsTgt["name"] = tgt.Name;
+              jsTgt["project"] = tgt.ProjectName;
+              jsTgt["type"] = CMakeTarget::stringFromType(tgt.Type);
+              QJsonArray bt;
+              for (auto const& frame : tgt.Backtrace)
+                {
+                  bt.append(toJsonArray(frame.first, frame.second));
+                }
+              jsTgt["backtrace"] = bt;
+              jsTargets.append(jsTgt);
+            }
+          QJsonObject result;
+          result["configs"] = toJsonArray(buildsystem.Configs);
+          result["targets"] = jsTargets;
+          return result;
+        });
+    }
+  else if (query.type == QLatin1String("target_info") && !query.args.isEmpty())
+    {
+      answerFrom(query.id, mClient->retrieveSources(query.args.first()),
+                 [](const CMakeTargetInfo& info) {
+          QJsonObject result;
+          result["target"] = info.Name;
+          result["sources"] = toJsonArray(info.Sources);
+          result["generated_sources"] = toJsonArray(info.GeneratedSources);
+          result["include_directories"] =
+              toJsonArray(info.IncludeDirectories);
+          result["compile_definitions"] =
+              toJsonArray(info.CompileDefinitions);
+          return result;
+        });
+    }
+  else if (query.type == QLatin1String("content") && query.args.size() == 2)
+    {
+      QFile file(query.args.first());
+      if (!file.open(QIODevice::ReadOnly))
+        {
+          return false;
+        }
+      auto future = mClient->retrieveContent(query.args.at(1).toLong(),
+                                             query.args.first(),
+                                             QString::fromUtf8(file.readAll()));
+      answerFrom(query.id, future, [](const QMap<QString, QString>& defs) {
+          QJsonObject result;
+          result["definitions"] = toJsonObject(defs);
+          return result;
+        });
+    }
+  else if (query.type == QLatin1String("parse") && query.args.size() == 1)
+    {
+      answerFrom(query.id, mClient->retrieveParsed(query.args.first()),
+                 [](const CMakeParseResult& parsed) {
+          QJsonArray jsUnreachable;
+          for (auto it = parsed.Unreachable.constBegin();
+               it != parsed.Unreachable.constEnd(); ++it)
+            {
+              jsUnreachable.append(toJsonArray(it.key(), it.value()));
+            }
+          QJsonArray tokens;
+          for (auto const& fragment : parsed.Fragments)
+            {
+              QJsonArray token;
+              token.append(fragment.line);
+              token.append(fragment.column);
+              token.append(fragment.length);
+              token.append(int(fragment.tokenType));
+              tokens.append(token);
+            }
+          QJsonObject result;
+          result["unreachable"] = jsUnreachable;
+          result["tokens"] = tokens;
+          return result;
+        });
+    }
+  else
+    {
+      return false;
+    }
+  return true;
+}
+
+void BatchRunner::pump()
+{
+  if (mFinished || mClient->GetState() != CMakeClient::Idle)
+    {
+      return;
+    }
+
+  while (!mScript.isEmpty() && (mDepth <= 0 || mInFlight.size() < mDepth))
+    {
+      auto& next = mScript.head();
+      if (next.type == QLatin1String("target_info")
+          && next.args == QStringList(QStringLiteral("*")))
+        {
+          if (!mInFlight.isEmpty())
+            {
+              // Wait for the buildsystem reply to name the targets.
+              return;
+            }
+          mScript.dequeue();
+          for (int i = mTargets.size() - 1; i >= 0; --i)
+            {
+              Query query;
+              query.id = 0;
+              query.type = QStringLiteral("target_info");
+              query.args = QStringList(mTargets.at(i));
+              query.sentAt = 0;
+              query.answeredAt = 0;
+              query.answered = false;
+              mScript.prepend(query);
+            }
+          continue;
+        }
+
+      auto query = mScript.dequeue();
+      if (!send(query))
+        {
+          emitError(query, QStringLiteral("invalid query"));
+          mExitCode = 1;
+          continue;
+        }
+      mInFlight.enqueue(query);
+    }
+
+  if (mScript.isEmpty() && mInFlight.isEmpty())
+    {
+      mOut.flush();
+      if (!mFinished)
+        {
+          mFinished = true;
+          Q_EMIT finished(mExitCode);
+        }
+    }
+}
+
+void BatchRunner::answer(int id, const QJsonObject& result,
+                         const QString& error)
+{
+  for (auto& query : mInFlight)
+    {
+      if (query.id == id)
+        {
+          query.answered = true;
+          query.answeredAt = mClock.nsecsElapsed();
+          query.result = result;
+          query.error = error;
+          break;
+        }
+    }
+
+  while (!mInFlight.isEmpty() && mInFlight.head().answered)
+    {
+      auto query = mInFlight.dequeue();
+      if (!query.error.isEmpty())
+        {
+          emitError(query, query.error);
+          mExitCode = 1;
+        }
+      else
+        {
+          emitResult(query);
+        }
+    }
+
+  pump();
+}
+
+void BatchRunner::emitResult(const Query& query)
+{
+  QJsonObject line;
+  line["seq"] = mSeq++;
+  line["query"] = query.type;
+  line["args"] = toJsonArray(query.args);
+  line["latency_us"] = double((query.answeredAt - query.sentAt) / 1000);
+  line["result"] = query.result;
+  mOut.write(QJsonDocument(line).toJson(QJsonDocument::Compact));
+  mOut.write("\n");
+}
+
+void BatchRunner::emitError(const Query& query, const QString& error)
+{
+  QJsonObject line;
+  line["query"] = query.type;
+  line["args"] = toJsonArray(query.args);
+  line["error"] = error;
+  mOut.write(QJsonDocument(line).toJson(QJsonDocument::Compact));
+  mOut.write("\n");
+}
+
+int main(int argc, char** argv)
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("cmakekate-cli"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+        QStringLiteral("Run batches of CMake daemon queries and print the "
+                       "results as newline-delimited JSON."));
+  parser.addHelpOption();
+  parser.addPositionalArgument(QStringLiteral("build-dir"),
+                               QStringLiteral("The CMake build directory."));
+
+  QCommandLineOption cmakeOption(QStringLiteral("cmake"),
+        QStringLiteral("The cmake executable."),
+        QStringLiteral("path"), QStringLiteral("cmake"));
+  QCommandLineOption scriptOption(QStringLiteral("script"),
+        QStringLiteral("Read queries from <file> instead of stdin."),
+        QStringLiteral("file"));
+  QCommandLineOption depthOption(QStringLiteral("depth"),
+        QStringLiteral("Queries kept in flight at once; 0 for no limit."),
+        QStringLiteral("n"), QStringLiteral("0"));
+  QCommandLineOption replayOption(QStringLiteral("replay"),
+        QStringLiteral("Answer queries from a protocol recording instead of "
+                       "a daemon."),
+        QStringLiteral("file"));
+  QCommandLineOption statsOption(QStringLiteral("stats"),
+        QStringLiteral("Print request statistics as JSON to stderr."));
+  QCommandLineOption timeoutOption(QStringLiteral("timeout"),
+        QStringLiteral("Give up after <seconds>; 0 waits forever."),
+        QStringLiteral("seconds"), QStringLiteral("0"));
+  parser.addOption(cmakeOption);
+  parser.addOption(scriptOption);
+  parser.addOption(depthOption);
+  parser.addOption(replayOption);
+  parser.addOption(statsOption);
+  QCommandLineOption benchOption(QStringLiteral("bench-requests"),
+        QStringLiteral("Time <n> rounds of request serialization and exit."),
+        QStringLiteral("n"));
+  QCommandLineOption bulkOption(QStringLiteral("bulk"),
+        QStringLiteral("Offer the daemon a shared memory segment for large "
+                       "replies."));
+  parser.addOption(timeoutOption);
+  parser.addOption(benchOption);
+  parser.addOption(bulkOption);
+  parser.process(app);
+
+  if (parser.isSet(benchOption))
+    {
+      return benchRequests(parser.value(benchOption).toInt());
+    }
+
+  auto positional = parser.positionalArguments();
+  if (positional.size() != 1 && !parser.isSet(replayOption))
+    {
+      parser.showHelp(1);
+    }
+
+  QFile scriptFile;
+  if (parser.isSet(scriptOption))
+    {
+      scriptFile.setFileName(parser.value(scriptOption));
+      if (!scriptFile.open(QIODevice::ReadOnly))
+        {
+          fprintf(stderr, "Cannot read %s\n", qPrintable(scriptFile.fileName()));
+          return 1;
+        }
+    }
+  else
+    {
+      scriptFile.open(stdin, QIODevice::ReadOnly);
+    }
+  auto script = QString::fromUtf8(scriptFile.readAll()).split(QLatin1Char('\n'));
+
+  CMakeClient client;
+  // --depth alone bounds what is in flight; every query is written to the
+  // daemon at once, so none waits in the client to be superseded.
+  auto depth = parser.value(depthOption).toInt();
+  auto inFlightLimit = depth > 0 ? depth : std::numeric_limits<int>::max();
+  client.setInFlightLimit(CMakeClient::Interactive, inFlightLimit);
+  client.setInFlightLimit(CMakeClient::Bulk, inFlightLimit);
+  client.setBulkChannel(parser.isSet(bulkOption));
+  BatchRunner runner(&client, script, depth);
+
+  int exitCode = 0;
+  QObject::connect(&runner, &BatchRunner::finished, [&](int code) {
+      exitCode = code;
+      app.quit();
+    });
+
+  QTimer timeoutTimer;
+  timeoutTimer.setSingleShot(true);
+  QObject::connect(&timeoutTimer, &QTimer::timeout, [&] {
+      fprintf(stderr, "Timed out\n");
+      exitCode = 2;
+      app.quit();
+    });
+  auto timeout = parser.value(timeoutOption).toInt();
+  if (timeout > 0)
+    {
+      timeoutTimer.start(timeout * 1000);
+    }
+
+  // Queries are sent once the client reports Idle, which a replayed
+  // recording does from within ProtocolReplay::start().
+  runner.start();
+
+  ProtocolReplay replay;
+  if (parser.isSet(replayOption))
+    {
+      QFile recording(parser.value(replayOption));
+      if (!recording.open(QIODevice::ReadOnly) || !replay.load(&recording))
+        {
+          fprintf(stderr, "Cannot read recording %s\n",
+                  qPrintable(recording.fileName()));
+          return 1;
+        }
+      // Queries left once every reply is fed will never be answered.  The
+      // answers to the last replies are delivered from the event loop, so
+      // are waited for first.
+      QObject::connect(&replay, &ProtocolReplay::finished, &runner, [&] {
+          QTimer::singleShot(0, &runner, [&] {
+              runner.abandon(QStringLiteral("recording exhausted"));
+            });
+        });
+      client.startOffline();
+      replay.start(&client, ProtocolReplay::MaximumSpeed);
+    }
+  else
+    {
+      client.start(parser.value(cmakeOption), positional.first());
+    }
+
+  if (!runner.isFinished())
+    {
+      app.exec();
+    }
+
+  if (parser.isSet(statsOption))
+    {
+      fprintf(stderr, "%s", client.stats().toJson().constData());
+    }
+  return exitCode;
+}
+
+#include "cmakekatecli.moc"
@@ -0,0 +1,388 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+// A stand-in for "cmake -E daemon" which answers every request with
+// generated data of a configurable size, so that the client's reply
+// handling can be measured without a real project:
+//
+//   cmakekate-cli --cmake "cmakekate-mockdaemon --targets 5000" --stats dir
+//
+// Options, which must come before "-E daemon <build-dir>":
+//
+//   --targets <n>   targets in the buildsystem reply (default 1000)
+//   --tokens <n>    tokens in each parse reply (default 100000)
+//   --json-only     decline the CBOR encoding offered at handshake
+//
+// Replies are JSON until the handshake; after it they are CBOR if the
+// client offered it, this build supports it and --json-only is not given.
+// Given a segment in CMAKEKATE_BULK_KEY, replies of 64 KiB or more go
+// through it whenever the client has released the previous one.
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSharedMemory>
+#include <QtEndian>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QCborValue>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#define MAGIC_START "\n[== CMake MetaMagic ==[\n"
+#define MAGIC_END "\n]== CMake MetaMagic ==]\n"
+#define MAGIC_START_CBOR "\n[== CMake MetaMagic CBOR ==[\n"
+#define MAGIC_START_BULK "\n[== CMake MetaMagic BULK ==[\n"
+
+namespace {
+
+class MockDaemon
+{
+public:
+  MockDaemon(const QString& buildDir, int targets, int tokens, bool jsonOnly)
+    : mBuildDir(buildDir), mTargets(targets), mTokens(tokens),
+      mJsonOnly(jsonOnly)
+  {
+  }
+
+  int run();
+
+private:
+  void handleRequest(const QJsonObject& request);
+  void send(const QJsonObject& reply);
+  void sendProgress(const char* progress);
+  bool sendBulk(const QByteArray& payload);
+
+  QJsonObject buildsystem() const;
+  QJsonObject targetInfo(const QString& name) const;
+  QJsonObject parsed() const;
+
+private:
+  QString mBuildDir;
+  int mTargets;
+  int mTokens;
+  bool mJsonOnly;
+  bool mCbor = false;
+  QSharedMemory mBulk;
+
+  // Matches SharedMemoryTransport.
+  static const int bulkDataOffset = 16;
+  static const int bulkThreshold = 64 * 1024;
+};
+
+int MockDaemon::run()
+{
+  auto bulkKey = qgetenv("CMAKEKATE_BULK_KEY");
+  if (!bulkKey.isEmpty())
+    {
+      mBulk.setKey(QString::fromLocal8Bit(bulkKey));
+      if (!mBulk.attach())
+        {
+          fprintf(stderr, "No bulk segment: %s\n",
+                  qPrintable(mBulk.errorString()));
+        }
+    }
+  sendProgress("process-started");
+
+  // QFile would wait to fill the whole chunk; take whatever has arrived.
+  QByteArray buffer;
+  char chunk[65536];
+  Q_FOREVER {
+    auto size = read(STDIN_FILENO, chunk, sizeof(chunk));
+    if (size <= 0)
+      {
+        return 0;
+      }
+    buffer.append(chunk, int(size));
+
+    Q_FOREVER {
+      int startPoint = buffer.indexOf(MAGIC_START);
+      int endPoint = buffer.indexOf(MAGIC_END, startPoint);
+      if (startPoint == -1 || endPoint == -1)
+        {
+          break;
+        }
+      startPoint += sizeof(MAGIC_START) - 1;
+      auto request = QJsonDocument::fromJson(
+            buffer.mid(startPoint, endPoint - startPoint)).object();
+      buffer = buffer.mid(endPoint + sizeof(MAGIC_END) - 1);
+      handleRequest(request);
+    }
+  }
+}
+
+void MockDaemon::handleRequest(const QJsonObject& request)
+{
+  auto type = request["type"].toString();
+  QJsonObject reply;
+  if (type == QLatin1String("handshake"))
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+      if (!mJsonOnly
+          && request["encodings"].toArray().contains(QStringLiteral("cbor")))
+        {
+          QJsonObject accepted;
+          accepted["progress"] = QStringLiteral("handshake-accepted");
+          accepted["encoding"] = QStringLiteral("cbor");
+          send(accepted);
+          mCbor = true;
+        }
+#endif
+      QJsonObject idle;
+      idle["progress"] = QStringLiteral("idle");
+      idle["binary_dir"] = mBuildDir;
+      idle["source_dir"] = mBuildDir + QStringLiteral("/src");
+      idle["project_name"] = QStringLiteral("mock");
+      send(idle);
+      return;
+    }
+
+  if (type == QLatin1String("buildsystem"))
+    {
+      reply["buildsystem"] = buildsystem();
+    }
+  else if (type == QLatin1String("target_info"))
+    {
+      reply["target_info"] = targetInfo(request["target_name"].toString());
+    }
+  else if (type == QLatin1String("parse"))
+    {
+      reply["parsed"] = parsed();
+    }
+  else if (type == QLatin1String("content_diff"))
+    {
+      QJsonObject diff;
+      diff["addedDefs"] = QJsonArray();
+      diff["removedDefs"] = QJsonArray();
+      reply["content_diff"] = diff;
+    }
+  else if (type == QLatin1String("code_complete"))
+    {
+      QJsonObject completion;
+      completion["result"] = QStringLiteral("no_completions");
+      reply["completion"] = completion;
+    }
+  else if (type == QLatin1String("contextual_help"))
+    {
+      QJsonObject help;
+      help["nocontext"] = true;
+      reply["contextual_help"] = help;
+    }
+  else
+    {
+      reply["content"] = QJsonObject();
+    }
+  send(reply);
+}
+
+void MockDaemon::send(const QJsonObject& reply)
+{
+  QByteArray payload;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (mCbor)
+    {
+      payload = QCborValue::fromJsonValue(reply).toCbor();
+    }
+  else
+#endif
+    {
+      payload = QJsonDocument(reply).toJson(QJsonDocument::Compact);
+    }
+  if (sendBulk(payload))
+    {
+      return;
+    }
+
+  QByteArray frame;
+  if (mCbor)
+    {
+      uchar length[4];
+      qToLittleEndian<quint32>(payload.size(), length);
+      frame += MAGIC_START_CBOR;
+      frame.append(reinterpret_cast<const char*>(length), 4);
+      frame += payload;
+    }
+  else
+    {
+      frame += MAGIC_START;
+      frame += payload;
+      frame += MAGIC_END;
+    }
+  fwrite(frame.constData(), 1, frame.size(), stdout);
+  fflush(stdout);
+}
+
+bool MockDaemon::sendBulk(const QByteArray& payload)
+{
+  if (!mBulk.isAttached() || payload.size() < bulkThreshold
+      || payload.size() > mBulk.size() - bulkDataOffset)
+    {
+      return false;
+    }
+  mBulk.lock();
+  auto busy = static_cast<quint32*>(mBulk.data());
+  if (*busy)
+    {
+      mBulk.unlock();
+      return false;
+    }
+  memcpy(static_cast<char*>(mBulk.data()) + bulkDataOffset,
+         payload.constData(), payload.size());
+  *busy = 1;
+  mBulk.unlock();
+
+  uchar length[4];
+  qToLittleEndian<quint32>(payload.size(), length);
+  fwrite(MAGIC_START_BULK, 1, sizeof(MAGIC_START_BULK) - 1, stdout);
+  fwrite(length, 1, 4, stdout);
+  fflush(stdout);
+  return true;
+}
+
+void MockDaemon::sendProgress(const char* progress)
+{
+  QJsonObject obj;
+  obj["progress"] = QLatin1String(progress);
+  send(obj);
+}
+
+QJsonObject MockDaemon::buildsystem() const
+{
+  QJsonArray configs;
+  configs.append(QStringLiteral("Debug"));
+
+  QJsonArray targets;
+  for (int i = 0; i < mTargets; ++i)
+    {
+      QJsonObject frame;
+      frame["path"] = mBuildDir + QStringLiteral("/src/CMakeLists.txt");
+      frame["line"] = 10 + i;
+      QJsonArray backtrace;
+      backtrace.append(frame);
+
+      QJsonArray dependencies;
+      if (i > 0)
+        {
+          dependencies.append(QStringLiteral("target%1").arg(i / 2));
+        }
+
+      QJsonObject target;
+      target["name"] = QStringLiteral("target%1").arg(i);
+      target["projectName"] = QStringLiteral("mock");
+      target["type"] = i ? QStringLiteral("STATIC_LIBRARY")
+                         : QStringLiteral("EXECUTABLE");
+      target["backtrace"] = backtrace;
+      target["dependencies"] = dependencies;
+      targets.append(target);
+    }
+
+  QJsonObject bs;
+  bs["configs"] = configs;
+  bs["targets"] = targets;
+  return bs;
+}
+
+QJsonObject MockDaemon::targetInfo(const QString& name) const
+{
+  QJsonArray sources;
+  for (int i = 0; i < 20; ++i)
+    {
+      sources.append(mBuildDir + QStringLiteral("/src/%1/file%2.cpp")
+                     .arg(name).arg(i));
+    }
+  QJsonArray includes;
+  includes.append(mBuildDir + QStringLiteral("/src/include"));
+  QJsonArray defines;
+  defines.append(QStringLiteral("MOCK_TARGET"));
+
+  QJsonObject info;
+  info["target_name"] = name;
+  info["object_sources"] = sources;
+  info["generated_object_sources"] = QJsonArray();
+  info["include_directories"] = includes;
+  info["compile_definitions"] = defines;
+  return info;
+}
+
+QJsonObject MockDaemon::parsed() const
+{
+  static const char* const types[] = {
+    "command", "left paren", "unquoted argument", "quoted argument",
+    "right paren"
+  };
+
+  QJsonArray tokens;
+  for (int i = 0; i < mTokens; ++i)
+    {
+      QJsonObject token;
+      token["line"] = 1 + i / 8;
+      token["column"] = 1 + (i % 8) * 10;
+      token["length"] = 8;
+      token["type"] = QLatin1String(types[i % 5]);
+      tokens.append(token);
+    }
+
+  QJsonObject parse;
+  parse["unreachable"] = QJsonArray();
+  parse["tokens"] = tokens;
+  return parse;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  int targets = 1000;
+  int tokens = 100000;
+  bool jsonOnly = false;
+  QString buildDir;
+  for (int i = 1; i < argc; ++i)
+    {
+      if (!strcmp(argv[i], "--targets") && i + 1 < argc)
+        {
+          targets = atoi(argv[++i]);
+        }
+      else if (!strcmp(argv[i], "--tokens") && i + 1 < argc)
+        {
+          tokens = atoi(argv[++i]);
+        }
+      else if (!strcmp(argv[i], "--json-only"))
+        {
+          jsonOnly = true;
+        }
+      else if (!strcmp(argv[i], "daemon") && i + 1 < argc)
+        {
+          buildDir = QString::fromLocal8Bit(argv[++i]);
+        }
+    }
+  if (buildDir.isEmpty())
+    {
+      fprintf(stderr, "Usage: %s [options] -E daemon <build-dir>\n", argv[0]);
+      return 1;
+    }
+
+  MockDaemon daemon(buildDir, targets, tokens, jsonOnly);
+  return daemon.run();
+}
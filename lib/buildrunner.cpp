@@ -0,0 +1,225 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "buildrunner.h"
+
+#include "targetgraph.h"
+#include "tracing.h"
+#include "utility.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QThread>
+
+BuildRunner::BuildRunner(QObject* parent)
+  : QObject(parent), mJobs(QThread::idealThreadCount())
+{
+  mProcess = createProcess();
+}
+
+BuildRunner::~BuildRunner()
+{
+  disconnect(mProcess, nullptr, this, nullptr);
+}
+
+QProcess* BuildRunner::createProcess()
+{
+  auto process = new QProcess(this);
+  process->setProcessChannelMode(QProcess::MergedChannels);
+  connect(process, &QProcess::readyReadStandardOutput,
+          this, &BuildRunner::readOutput);
+  connect(process, SELECT<int, QProcess::ExitStatus>::OVERLOAD_OF(&QProcess::finished),
+          this, [this](int exitCode, QProcess::ExitStatus status) {
+      readOutput();
+      if (!mPartialLine.isEmpty())
+        {
+          parseLine(QString::fromLocal8Bit(mPartialLine));
+          mPartialLine.clear();
+        }
+      Q_EMIT finished(status == QProcess::NormalExit && exitCode == 0);
+    });
+  return process;
+}
+
+QStringList BuildRunner::minimalTargets(const TargetGraph& graph,
+                                        const QStringList& changedTargets)
+{
+  CMK_TRACE_SCOPE("build", "minimal targets");
+
+  QVector<int> affected;
+  QVector<bool> seen(graph.targetCount(), false);
+  for (auto const& name : changedTargets)
+    {
+      auto index = graph.indexOf(name);
+      if (index < 0 || seen.at(index))
+        {
+          continue;
+        }
+      seen[index] = true;
+      affected.append(index);
+      for (auto dependent : graph.transitiveDependents(index))
+        {
+          if (!seen.at(dependent))
+            {
+              seen[dependent] = true;
+              affected.append(dependent);
+            }
+        }
+    }
+
+  QStringList result;
+  for (auto candidate : affected)
+    {
+      bool builtByOther = false;
+      for (auto other : affected)
+        {
+          if (other != candidate && graph.dependsOn(other, candidate)
+              && !graph.dependsOn(candidate, other))
+            {
+              builtByOther = true;
+              break;
+            }
+        }
+      if (!builtByOther)
+        {
+          result.append(graph.name(candidate));
+        }
+    }
+  return result;
+}
+
+void BuildRunner::setJobs(int jobs)
+{
+  mJobs = qMax(1, jobs);
+}
+
+int BuildRunner::jobs() const
+{
+  return mJobs;
+}
+
+bool BuildRunner::start(const QString& buildDir, const QStringList& targets)
+{
+  QString program;
+  QStringList args;
+  if (QFile::exists(buildDir + QStringLiteral("/build.ninja")))
+    {
+      program = QStringLiteral("ninja");
+    }
+  else if (QFile::exists(buildDir + QStringLiteral("/Makefile")))
+    {
+      program = QStringLiteral("make");
+    }
+  else
+    {
+      return false;
+    }
+  args << QStringLiteral("-C") << buildDir
+       << QStringLiteral("-j") << QString::number(mJobs)
+       << targets;
+
+  cancel();
+  mBuildDir = buildDir;
+  mDiagnostics.clear();
+  mDiagnosticsByFile.clear();
+  mPartialLine.clear();
+
+  mProcess->setWorkingDirectory(buildDir);
+  mProcess->start(program, args);
+  return true;
+}
+
+void BuildRunner::cancel()
+{
+  if (mProcess->state() == QProcess::NotRunning)
+    {
+      return;
+    }
+  // The killed build is left to exit by itself, and the next one gets a
+  // process of its own.
+  auto killed = mProcess;
+  disconnect(killed, nullptr, this, nullptr);
+  connect(killed, SELECT<int, QProcess::ExitStatus>::OVERLOAD_OF(&QProcess::finished),
+          killed, &QObject::deleteLater);
+  killed->kill();
+  mProcess = createProcess();
+}
+
+bool BuildRunner::isRunning() const
+{
+  return mProcess->state() != QProcess::NotRunning;
+}
+
+const QVector<BuildRunner::Diagnostic>& BuildRunner::diagnostics() const
+{
+  return mDiagnostics;
+}
+
+QVector<int> BuildRunner::diagnosticsForFile(const QString& file) const
+{
+  return mDiagnosticsByFile.value(QDir::cleanPath(file));
+}
+
+void BuildRunner::readOutput()
+{
+  mPartialLine += mProcess->readAllStandardOutput();
+  int start = 0;
+  Q_FOREVER {
+    int end = mPartialLine.indexOf('\n', start);
+    if (end == -1)
+      {
+        break;
+      }
+    parseLine(QString::fromLocal8Bit(mPartialLine.constData() + start,
+                                     end - start));
+    start = end + 1;
+  }
+  mPartialLine.remove(0, start);
+}
+
+void BuildRunner::parseLine(const QString& line)
+{
+  Q_EMIT outputLine(line);
+
+  // file:line:column: severity: message, as written by GCC and Clang.
+  static const QRegularExpression diagnosticPattern(QStringLiteral(
+      "^(.+?):(\\d+):(?:(\\d+):)? (?:fatal )?(error|warning|note): (.*)$"));
+  auto match = diagnosticPattern.match(line);
+  if (!match.hasMatch())
+    {
+      return;
+    }
+
+  Diagnostic diagnostic;
+  // Ninja reports paths relative to the build directory.
+  diagnostic.File = QDir::cleanPath(QDir(mBuildDir).absoluteFilePath(match.captured(1)));
+  diagnostic.Line = match.captured(2).toInt();
+  diagnostic.Column = match.captured(3).toInt();
+  auto kind = match.capturedRef(4);
+  diagnostic.Kind = kind == QLatin1String("error") ? Error
+      : kind == QLatin1String("warning") ? Warning : Note;
+  diagnostic.Message = match.captured(5);
+
+  auto index = mDiagnostics.size();
+  mDiagnostics.append(diagnostic);
+  mDiagnosticsByFile[diagnostic.File].append(index);
+  Q_EMIT diagnosticAdded(index);
+}
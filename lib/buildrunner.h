@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class QProcess;
+class TargetGraph;
+
+// Builds a set of targets with the native tool of the build directory and
+// collects the compiler diagnostics from its output as it arrives.
+class BuildRunner : public QObject
+{
+  Q_OBJECT
+public:
+  enum Severity {
+    Error,
+    Warning,
+    Note
+  };
+
+  struct Diagnostic
+  {
+    QString File;
+    int Line;
+    int Column;
+    Severity Kind;
+    QString Message;
+  };
+
+  BuildRunner(QObject* parent = 0);
+  ~BuildRunner();
+
+  // The targets to build so that everything depending on the changed ones
+  // is up to date.  Targets which another chosen target depends on are
+  // left out, as the tool builds them on the way.
+  static QStringList minimalTargets(const TargetGraph& graph,
+                                    const QStringList& changedTargets);
+
+  void setJobs(int jobs);
+  int jobs() const;
+
+  // False if the build directory has neither build.ninja nor a Makefile.
+  bool start(const QString& buildDir, const QStringList& targets);
+  // Kills the running build without waiting for it; it emits nothing more.
+  void cancel();
+  bool isRunning() const;
+
+  const QVector<Diagnostic>& diagnostics() const;
+  QVector<int> diagnosticsForFile(const QString& file) const;
+
+Q_SIGNALS:
+  void outputLine(const QString& line);
+  void diagnosticAdded(int index);
+  void finished(bool success);
+
+private:
+  QProcess* createProcess();
+  void readOutput();
+  void parseLine(const QString& line);
+
+private:
+  QProcess* mProcess;
+  QString mBuildDir;
+  int mJobs;
+  QByteArray mPartialLine;
+  QVector<Diagnostic> mDiagnostics;
+  QHash<QString, QVector<int> > mDiagnosticsByFile;
+};
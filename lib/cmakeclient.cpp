@@ -18,20 +18,327 @@
 */
 
 #include "cmakeclient.h"
+#include "daemontransport.h"
+#include "jsonpullreader.h"
+#include "protocolrecorder.h"
+#include "replydecoder.h"
+#include "resultsstore.h"
+#include "tracing.h"
 
-#include <QProcess>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QMetaMethod>
+#include <QTimer>
+#include <QtEndian>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QCborStreamReader>
+#endif
 
 #define MAGIC_START "\n[== CMake MetaMagic ==[\n"
 #define MAGIC_END "\n]== CMake MetaMagic ==]\n"
+// A binary frame carries its length, as a little endian quint32 after the
+// marker, instead of an end marker which the payload might contain.
+#define MAGIC_START_CBOR "\n[== CMake MetaMagic CBOR ==[\n"
+// A bulk frame has only the length, of a payload in the daemon's shared
+// memory segment.
+#define MAGIC_START_BULK "\n[== CMake MetaMagic BULK ==[\n"
+
+namespace {
+
+// The handshake is the same for every daemon and is not answered.  A
+// daemon which understands the encodings offered acknowledges the one it
+// picks with a "handshake-accepted" progress message; others ignore the
+// offer and keep to JSON.
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+const char handshakeFrame[] = MAGIC_START
+    "{\"type\":\"handshake\",\"encodings\":[\"cbor\",\"json\"]}" MAGIC_END;
+#else
+const char handshakeFrame[] = MAGIC_START "{\"type\":\"handshake\"}" MAGIC_END;
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+bool isCborPayload(const QByteArray& payload)
+{
+  // A CBOR map starts with major type 5; a JSON object with '{'.
+  return !payload.isEmpty() && (uchar(payload.at(0)) & 0xe0) == 0xa0;
+}
+
+// Decodes the value at the reader into the JSON form the reply handlers
+// take, without building a QCborValue first.
+QJsonValue readCborValue(QCborStreamReader& reader)
+{
+  switch (reader.type())
+    {
+    case QCborStreamReader::UnsignedInteger:
+    case QCborStreamReader::NegativeInteger:
+      {
+        auto value = double(reader.toInteger());
+        reader.next();
+        return value;
+      }
+    case QCborStreamReader::String:
+      {
+        QString str;
+        auto chunk = reader.readString();
+        while (chunk.status == QCborStreamReader::Ok)
+          {
+            str += chunk.data;
+            chunk = reader.readString();
+          }
+        return str;
+      }
+    case QCborStreamReader::Array:
+      {
+        QJsonArray array;
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext())
+          {
+            array.append(readCborValue(reader));
+          }
+        reader.leaveContainer();
+        return array;
+      }
+    case QCborStreamReader::Map:
+      {
+        QJsonObject obj;
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext())
+          {
+            auto key = readCborValue(reader).toString();
+            obj.insert(key, readCborValue(reader));
+          }
+        reader.leaveContainer();
+        return obj;
+      }
+    case QCborStreamReader::SimpleType:
+      {
+        QJsonValue value;
+        if (reader.isTrue() || reader.isFalse())
+          {
+            value = reader.toBool();
+          }
+        reader.next();
+        return value;
+      }
+    case QCborStreamReader::Float16:
+      {
+        auto value = double(reader.toFloat16());
+        reader.next();
+        return value;
+      }
+    case QCborStreamReader::Float:
+      {
+        auto value = double(reader.toFloat());
+        reader.next();
+        return value;
+      }
+    case QCborStreamReader::Double:
+      {
+        auto value = reader.toDouble();
+        reader.next();
+        return value;
+      }
+    case QCborStreamReader::Tag:
+      reader.next();
+      return readCborValue(reader);
+    default:
+      reader.next();
+      return QJsonValue();
+    }
+}
+#endif
+
+// Whether the reply is an unsolicited progress message, judged from its
+// top level keys alone.
+bool isProgressReply(const QByteArray& payload)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (isCborPayload(payload))
+    {
+      QCborStreamReader reader(payload);
+      if (!reader.isMap())
+        {
+          return false;
+        }
+      reader.enterContainer();
+      while (reader.lastError() == QCborError::NoError && reader.hasNext())
+        {
+          if (readCborValue(reader).toString() == QLatin1String("progress"))
+            {
+              return true;
+            }
+          reader.next();
+        }
+      return false;
+    }
+#endif
+  JsonPullReader reader;
+  reader.setData(payload.constData(), payload.size());
+  if (reader.next() != JsonPullReader::BeginObject)
+    {
+      return false;
+    }
+  Q_FOREVER {
+    if (reader.next() != JsonPullReader::String)
+      {
+        return false;
+      }
+    if (reader.stringEquals("progress"))
+      {
+        return true;
+      }
+    auto last = reader.skipValue(reader.next());
+    if (last == JsonPullReader::Invalid || last == JsonPullReader::NeedData)
+      {
+        return false;
+      }
+  }
+}
+
+bool decodeReply(const QByteArray& payload, QJsonObject* reply)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (isCborPayload(payload))
+    {
+      QCborStreamReader reader(payload);
+      auto value = readCborValue(reader);
+      if (reader.lastError() != QCborError::NoError || !value.isObject())
+        {
+          return false;
+        }
+      *reply = value.toObject();
+      return true;
+    }
+#endif
+  auto jsonDoc = QJsonDocument::fromJson(payload);
+  if (!jsonDoc.isObject())
+    {
+      return false;
+    }
+  *reply = jsonDoc.object();
+  return true;
+}
+
+// Finds the first complete text frame starting at or after from.  Returns
+// where its payload starts, setting payloadEnd to where it ends, or -1 if
+// there is none yet.
+int findTextFrame(const QByteArray& buffer, int from, int* payloadEnd)
+{
+  int startPoint = buffer.indexOf(MAGIC_START, from);
+  if (startPoint == -1)
+    {
+      return -1;
+    }
+  int endPoint = buffer.indexOf(MAGIC_END, startPoint);
+  if (endPoint == -1)
+    {
+      return -1;
+    }
+  *payloadEnd = endPoint;
+  return startPoint + int(sizeof(MAGIC_START) - 1);
+}
+
+// Requests with the same key ask the same question of newer content, so a
+// queued one can be replaced by its successor.  Empty for requests which
+// must each be answered; completion, help and content are about a
+// position in the file, and each caller waits for its own answer.
+QString supersedeKey(const QString& type, const QString& subject,
+                     const QString& config)
+{
+  if (type == QLatin1String("target_info")
+      || type == QLatin1String("parse"))
+    {
+      return type + QLatin1Char('\n') + subject + QLatin1Char('\n') + config;
+    }
+  return QString();
+}
+
+// FNV-1a over the Latin-1 bytes of a reply or completion kind.  The
+// constexpr overload lets the dispatch tables be keyed by values computed
+// at compile time.
+constexpr quint32 kindHash(const char* s, quint32 h = 2166136261u)
+{
+  return *s ? kindHash(s + 1, (h ^ quint8(*s)) * 16777619u) : h;
+}
+
+quint32 kindHash(const QString& s)
+{
+  quint32 h = 2166136261u;
+  for (auto it = s.constBegin(); it != s.constEnd(); ++it)
+    {
+      h = (h ^ quint8(it->unicode())) * 16777619u;
+    }
+  return h;
+}
+
+struct CompletionKind
+{
+  quint32 hash;
+  const char* name;
+};
+
+#define COMPLETION_KIND(NAME) { kindHash(NAME), NAME }
+
+// The keys under which the daemon reports completion candidates.
+const CompletionKind completionKinds[] = {
+  COMPLETION_KIND("targets"),
+  COMPLETION_KIND("commands"),
+  COMPLETION_KIND("variables"),
+  COMPLETION_KIND("packages"),
+  COMPLETION_KIND("modules"),
+  COMPLETION_KIND("policies"),
+  COMPLETION_KIND("keywords")
+};
+
+#undef COMPLETION_KIND
+
+bool isCompletionKind(const QString& key)
+{
+  auto h = kindHash(key);
+  for (auto const& kind : completionKinds)
+    {
+      if (kind.hash == h)
+        {
+          return key == QLatin1String(kind.name);
+        }
+    }
+  return false;
+}
+
+}
 
 CMakeClient::CMakeClient(QObject* parent)
-  : QObject(parent), mServerProcess(nullptr)
+  : QObject(parent), mDaemon(nullptr), mStandbyDaemon(nullptr),
+    mRecorder(nullptr)
 {
   mState = NotRunning;
+  mClock.start();
+
+  mHibernateTimer = new QTimer(this);
+  mHibernateTimer->setSingleShot(true);
+  mHibernateTimer->setInterval(0);
+  connect(mHibernateTimer, &QTimer::timeout, this, &CMakeClient::hibernate);
+
+  mReplyDecoder = new ReplyDecoder;
+  mResults = new ResultsStore;
+}
+
+CMakeClient::~CMakeClient()
+{
+  clearRequests();
+  delete mReplyDecoder;
+  delete mResults;
+}
+
+template <typename T>
+void CMakeClient::reportReply(const T& result)
+{
+  QFutureInterface<T> promise(mReply.promise);
+  promise.reportResult(result);
 }
 
 CMakeClient::State CMakeClient::GetState() const
@@ -49,6 +356,7 @@ void CMakeClient::handleContent(QJsonObject const& bs)
       map[jsIt.key()] = jsIt.value().toString();
     }
 
+  reportReply(map);
   Q_EMIT contentRetrieved(map);
 }
 
@@ -72,6 +380,10 @@ void CMakeClient::handleDiffContent(QJsonObject const& bs)
       Q_ASSERT(!obj["key"].toString().isEmpty());
       added[obj["key"].toString()] = obj["value"].toString();
     }
+  CMakeDiffContent diff;
+  diff.Added = added;
+  diff.Removed = removed;
+  reportReply(diff);
   Q_EMIT diffContentRetrieved(added, removed);
 }
 
@@ -87,33 +399,26 @@ void CMakeClient::handleParsed(const QJsonArray& unr, const QJsonArray& tok)
       unrMap[obj["begin"].toInt()] = obj["end"].toInt();
     }
 
+  fragments.reserve(tok.size());
   foreach(auto val, tok) {
     Fragment fragment;
     auto obj = val.toObject();
     fragment.line = obj["line"].toInt();
     fragment.column = obj["column"].toInt();
     fragment.length = obj["length"].toInt();
-    QString type = obj["type"].toString();
-    if (type == "command")
-      fragment.tokenType = Command;
-    else if (type == "user_command")
-      fragment.tokenType = UserCommand;
-    else if (type == "identifier")
-      fragment.tokenType = Identifier;
-    else if (type == "quoted argument") {
-      fragment.tokenType = QuotedArgument;
-      fragment.length += 2;
-    }
-    else if (type == "unquoted argument")
-      fragment.tokenType = Identifier;
-    else if (type == "left paren")
-      fragment.tokenType = OpenParen;
-    else if (type == "right paren")
-      fragment.tokenType = ClosedParen;
+    setTokenType(fragment, obj["type"].toString());
 
     fragments.push_back(fragment);
   }
 
+  CMakeParseResult result;
+  result.Unreachable = unrMap;
+  result.Fragments = fragments;
+  if (!mReply.subject.isEmpty())
+    {
+      mResults->insertParsed(mReply.generation, mReply.subject, result);
+    }
+  reportReply(result);
   Q_EMIT parsedRetrieved(unrMap, fragments);
 }
 
@@ -153,6 +458,17 @@ void CMakeClient::handleSources(const QJsonObject& tgtInfo)
   Q_EMIT sourcesRetrieved(tgtName, srcs, genSrcs);
   Q_EMIT includesRetrieved(incs);
   Q_EMIT definesRetrieved(defs);
+
+  CMakeTargetInfo info;
+  info.Name = tgtName;
+  info.Config = mReply.config;
+  info.Sources = srcs;
+  info.GeneratedSources = genSrcs;
+  info.IncludeDirectories = incs;
+  info.CompileDefinitions = defs;
+  mResults->insertTargetInfo(mReply.generation, info);
+  reportReply(info);
+  Q_EMIT targetInfoRetrieved(info);
 }
 
 void CMakeClient::handleBuildsystemData(QJsonObject const& bs)
@@ -183,10 +499,40 @@ void CMakeClient::handleBuildsystemData(QJsonObject const& bs)
         }
       std::reverse(bt.begin(), bt.end());
       tgt.Backtrace = bt;
+      foreach (auto dep, jsTO["dependencies"].toArray())
+        {
+          tgt.Dependencies.push_back(dep.toString());
+        }
 
       targets.push_back(tgt);
     }
-  Q_EMIT targetsRetrieved(configs, targets);
+  CMakeBuildsystem buildsystem;
+  buildsystem.Configs = configs;
+  buildsystem.Targets = targets;
+  storeBuildsystem(buildsystem);
+}
+
+void CMakeClient::storeBuildsystem(const CMakeBuildsystem& buildsystem)
+{
+  // A reply from cache (without a type) says nothing about the live build.
+  if (mVerifyBuildsystem && !mReply.type.isEmpty())
+    {
+      mVerifyBuildsystem = false;
+      if (mResults->hasBuildsystem()
+          && mResults->buildsystem() == buildsystem)
+        {
+          // The consumers already have these targets, from before or from
+          // cache; telling them again would make them refetch everything.
+          reportReply(buildsystem);
+          return;
+        }
+      qDebug() << "BUILD CHANGED" << mBuildDir;
+      advanceGeneration();
+      mReply.generation = mGeneration;
+    }
+  mResults->insertBuildsystem(mReply.generation, buildsystem);
+  reportReply(buildsystem);
+  Q_EMIT targetsRetrieved(buildsystem.Configs, buildsystem.Targets);
 }
 
 QString CMakeClient::buildDir() const
@@ -204,285 +550,1124 @@ QString CMakeClient::projectName() const
   return mProjectName;
 }
 
-void CMakeClient::start(QString const& cmakeExe, QString const& buildDir)
+QString CMakeClient::cmakeExecutable() const
 {
-  if (mServerProcess)
-  {
-    qDebug() << "TERM OLD" << mBuildDir;
-    delete mServerProcess;
-  }
+  return mCMakeExe;
+}
 
-  qDebug() << "START" << buildDir;
-  mBuildDir = buildDir;
-  mServerProcess = new QProcess(this);
+quint32 CMakeClient::generation() const
+{
+  return mGeneration;
+}
+
+const ResultsStore& CMakeClient::results() const
+{
+  return *mResults;
+}
+
+void CMakeClient::advanceGeneration()
+{
+  ++mGeneration;
+  mResults->advance(mGeneration);
+  Q_EMIT generationChanged();
+}
+
+const RequestStats& CMakeClient::stats() const
+{
+  return mStats;
+}
+
+void CMakeClient::clearStats()
+{
+  mStats.clear();
+}
 
-  auto handleServerData = [this](){
-      Q_FOREVER {
-        int startPoint = mDataBuffer.indexOf(MAGIC_START);
-        int endPoint = mDataBuffer.indexOf(MAGIC_END, startPoint);
-        if (startPoint == -1 || endPoint == -1)
+int CMakeClient::pendingRequests() const
+{
+  int count = mPending.size();
+  for (auto const& queue : mQueued)
+    {
+      count += queue.size();
+    }
+  return count;
+}
+
+void CMakeClient::handleProgress(const QJsonObject& obj)
+{
+  QString prog = obj.value("progress").toString();
+  if (prog == "process-started")
+    {
+      // A daemon replacing a crashed or hibernated one serves the same
+      // build, so the consumers keep what they have.
+      if (!mRecovering)
         {
-          return;
+          mState = Initializing;
+          Q_EMIT stateChanged();
+        }
+      if (!mHandshakeSent)
+        {
+          writeHandshake();
+        }
+    }
+  // A daemon replacing a crashed or hibernated one configures the build
+  // unseen by the consumers; once idle, its buildsystem is compared with
+  // the one before, in case the build changed meanwhile.
+  if (prog == "configuring" && !mRecovering)
+    {
+      // Configuring again after being idle means the daemon noticed a
+      // change to the build; what was asked of it before is stale.
+      if (mState == Idle)
+        {
+          advanceGeneration();
         }
-        startPoint += sizeof(MAGIC_START) - 1;
-        auto jsonData = mDataBuffer.mid(startPoint, endPoint - startPoint);
-        mDataBuffer = mDataBuffer.right(mDataBuffer.size() - endPoint - sizeof(MAGIC_END) + 1);
+      mState = Configuring;
+      Q_EMIT stateChanged();
+    }
+  if (prog == "computing" && !mRecovering)
+    {
+      mState = Computing;
+      Q_EMIT stateChanged();
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (prog == "handshake-accepted")
+    {
+      mWireFormat = obj.value("encoding").toString() == QLatin1String("cbor")
+          ? CborWire : JsonWire;
+    }
+#endif
+  if (prog == "idle")
+    {
+      mState = Idle;
+      mSourceDir = obj.value("source_dir").toString();
+      mProjectName = obj.value("project_name").toString();
+      if (mBuildDir.isEmpty())
+        {
+          // Replaying a recording; adopt the recorded build.
+          mBuildDir = obj.value("binary_dir").toString();
+        }
+      if (mBuildDir != obj.value("binary_dir").toString())
+        {
+          qDebug() << mBuildDir << obj.value("binary_dir").toString();
+        }
+      Q_ASSERT(mBuildDir == obj.value("binary_dir").toString());
+      mRestartCount = 0;
+      if (mRecovering)
+        {
+          mRecovering = false;
+          for (auto const& pending : mPending)
+            {
+              mDaemon->write(pending.frame);
+            }
+          pumpRequests();
+          if (mResults->hasBuildsystem())
+            {
+              mVerifyBuildsystem = true;
+              retrieveTargets();
+            }
+        }
+      Q_EMIT stateChanged();
+      // Need a message queue?
+    }
+}
 
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData);
+void CMakeClient::handleCompletion(const QJsonObject& completion)
+{
+  if (completion.value("result").toString() == QLatin1String("no_completions"))
+    {
+      reportReply(CMakeCompletions());
+      Q_EMIT completionsRetrieved(QString(), QStringList(), QStringList(),
+                                  QString());
+      return;
+    }
 
-        if (!jsonDoc.isObject()) {
-          return;
-          }
+  QString kind;
+  QString matcher;
+  QStringList strings;
+  QStringList descriptions;
+  for (auto it = completion.constBegin(); it != completion.constEnd(); ++it)
+    {
+      auto key = it.key();
+      if (key == QLatin1String("matcher"))
+        {
+          matcher = it.value().toString();
+        }
+      else if (key == QLatin1String("descriptions"))
+        {
+          foreach(auto res, it.value().toArray())
+            {
+              descriptions.push_back(res.toString());
+            }
+        }
+      else if (isCompletionKind(key))
+        {
+          if (kind.isEmpty())
+            {
+              kind = key;
+            }
+          foreach(auto res, it.value().toArray())
+            {
+              strings.push_back(res.toString());
+            }
+        }
+    }
+  CMakeCompletions completions;
+  completions.Matcher = matcher;
+  completions.Results = strings;
+  completions.Descriptions = descriptions;
+  completions.Kind = kind;
+  reportReply(completions);
+  Q_EMIT completionsRetrieved(matcher, strings, descriptions, kind);
+}
 
-        QJsonObject obj = jsonDoc.object();
+struct CMakeClient::ReplyHandler
+{
+  const char* kind;
+  void (*handle)(CMakeClient* client, const QJsonValue& value,
+                 const QJsonObject& reply);
+};
 
-        if (obj.contains("progress"))
+const QHash<quint32, CMakeClient::ReplyHandler>& CMakeClient::replyHandlers()
+{
+  static const ReplyHandler table[] = {
+    { "progress", [](CMakeClient* client, const QJsonValue&,
+                     const QJsonObject& reply) {
+        client->handleProgress(reply);
+      } },
+    { "buildsystem", [](CMakeClient* client, const QJsonValue& value,
+                        const QJsonObject&) {
+        client->handleBuildsystemData(value.toObject());
+      } },
+    { "content", [](CMakeClient* client, const QJsonValue& value,
+                    const QJsonObject&) {
+        client->handleContent(value.toObject());
+      } },
+    { "content_result", [](CMakeClient* client, const QJsonValue& value,
+                           const QJsonObject&) {
+        if (value.toString() == QLatin1String("unexecuted"))
           {
-            QString prog = obj.value("progress").toString();
-            if (prog == "process-started")
-              {
-                mState = Initializing;
-                emit stateChanged();
-                writeHandshake();
-              }
-            if (prog == "idle")
-              {
-                mState = Idle;
-                mSourceDir = obj.value("source_dir").toString();
-                mProjectName = obj.value("project_name").toString();
-                if (mBuildDir != obj.value("binary_dir").toString())
-                  {
-                    qDebug() << mBuildDir << obj.value("binary_dir").toString();
-                  }
-                Q_ASSERT(mBuildDir == obj.value("binary_dir").toString());
-                emit stateChanged();
-                // Need a message queue?
-              }
+            client->handleContent({});
           }
-        else if (obj.contains("buildsystem"))
+      } },
+    { "content_diff", [](CMakeClient* client, const QJsonValue& value,
+                         const QJsonObject&) {
+        client->handleDiffContent(value.toObject());
+      } },
+    { "target_info", [](CMakeClient* client, const QJsonValue& value,
+                        const QJsonObject&) {
+        client->handleSources(value.toObject());
+      } },
+    { "parsed", [](CMakeClient* client, const QJsonValue& value,
+                   const QJsonObject&) {
+        auto parsed = value.toObject();
+        client->handleParsed(parsed["unreachable"].toArray(),
+                             parsed["tokens"].toArray());
+      } },
+    { "contextual_help", [](CMakeClient* client, const QJsonValue& value,
+                            const QJsonObject&) {
+        auto help = value.toObject();
+        CMakeContextualHelp result;
+        if (!help.contains("nocontext"))
           {
-            auto bs = obj["buildsystem"].toObject();
-            handleBuildsystemData(bs);
+            result.Context = help["context"].toString();
+            result.Key = help["help_key"].toString();
           }
-        else if (obj.contains("content"))
+        client->reportReply(result);
+        Q_EMIT client->contextualHelpRetrieved(result.Context, result.Key);
+      } },
+    { "completion", [](CMakeClient* client, const QJsonValue& value,
+                       const QJsonObject&) {
+        client->handleCompletion(value.toObject());
+      } }
+  };
+
+  static const QHash<quint32, ReplyHandler> handlers = [] {
+      QHash<quint32, ReplyHandler> h;
+      for (auto const& entry : table)
+        {
+          Q_ASSERT(!h.contains(kindHash(entry.kind)));
+          h.insert(kindHash(entry.kind), entry);
+        }
+      return h;
+    }();
+  return handlers;
+}
+
+bool CMakeClient::dispatchReply(const QJsonObject& reply)
+{
+  auto const& handlers = replyHandlers();
+  for (auto it = reply.constBegin(); it != reply.constEnd(); ++it)
+    {
+      auto key = it.key();
+      auto handler = handlers.constFind(kindHash(key));
+      if (handler != handlers.constEnd()
+          && key == QLatin1String(handler->kind))
+        {
+          handler->handle(this, it.value(), reply);
+          return qstrcmp(handler->kind, "progress") != 0;
+        }
+    }
+  return true;
+}
+
+void CMakeClient::processServerData()
+{
+  Q_FOREVER {
+    CMK_TRACE_SCOPE("client", "reply frame");
+    QByteArray payload;
+    bool bulk = false;
+    qint64 frameSize = takeFrame(&payload, &bulk);
+    if (frameSize == 0)
+      {
+        decodePartialReply();
+        break;
+      }
+
+    if (mRecorder)
+      {
+        mRecorder->record(ProtocolRecorder::Reply,
+                          payload.constData(), payload.size());
+      }
+
+    // Made against a configuration which has since been replaced; only
+    // whether it is a reply at all needs reading.
+    if (!mPending.isEmpty() && mPending.head().generation != mGeneration
+        && !isProgressReply(payload))
+      {
+        auto pending = mPending.dequeue();
+        --mInFlight[pending.priority];
+        cancelRequest(pending);
+        if (bulk)
           {
-            auto bs = obj["content"].toObject();
-            handleContent(bs);
+            mDaemon->releaseBulk();
           }
-        else if (obj.contains("content_result"))
+        mReplyDecoder->reset();
+        mArrivedCount = 0;
+        continue;
+      }
+
+    QElapsedTimer timer;
+    timer.start();
+    QJsonObject reply;
+    bool decoded = false;
+    bool streamed = false;
+    {
+      CMK_TRACE_SCOPE("client", "parse");
+      // JSON buildsystem and parse replies go without a document, carrying
+      // on from wherever decodePartialReply() got to.
+      if (mWireFormat == JsonWire
+          && mReplyDecoder->feed(payload.constData(), payload.size())
+          && mReplyDecoder->isComplete())
+        {
+          streamed = mReplyDecoder->kind() == ReplyDecoder::Buildsystem
+                  || mReplyDecoder->kind() == ReplyDecoder::Parsed;
+        }
+      if (!streamed)
+        {
+          decoded = decodeReply(payload, &reply);
+        }
+    }
+    qint64 parseNs = timer.nsecsElapsed();
+    if (bulk)
+      {
+        // The decoded reply is a copy; hand the segment back to the daemon,
+        // keeping the payload only if it is to be cached.
+        payload = !mPending.isEmpty() && isCachedRequest(mPending.head().type)
+            ? QByteArray(payload.constData(), payload.size()) : QByteArray();
+        mDaemon->releaseBulk();
+      }
+
+    bool answersRequest = true;
+    mReply = headRequest();
+    if (streamed)
+      {
+        CMK_TRACE_SCOPE("client", "handle");
+        if (mReplyDecoder->kind() == ReplyDecoder::Buildsystem)
           {
-            auto bs = obj["content_result"].toString();
-            if (bs == "unexecuted")
+            CMakeBuildsystem buildsystem;
+            buildsystem.Configs = mReplyDecoder->configs();
+            buildsystem.Targets = mReplyDecoder->targets();
+            storeBuildsystem(buildsystem);
+          }
+        else
+          {
+            CMakeParseResult result;
+            result.Unreachable = mReplyDecoder->unreachable();
+            result.Fragments = mReplyDecoder->fragments();
+            if (!mReply.subject.isEmpty())
               {
-                handleContent({});
+                mResults->insertParsed(mReply.generation, mReply.subject,
+                                       result);
               }
+            reportReply(result);
+            Q_EMIT parsedRetrieved(result.Unreachable, result.Fragments);
           }
-        else if (obj.contains("content_diff"))
+      }
+    else if (decoded)
+      {
+        CMK_TRACE_SCOPE("client", "handle");
+        answersRequest = dispatchReply(reply);
+      }
+    qint64 handlerNs = timer.nsecsElapsed() - parseNs;
+    mReply = PendingRequest();
+    mReplyDecoder->reset();
+    mArrivedCount = 0;
+
+    // The daemon answers requests in the order they were written.
+    if (answersRequest && !mPending.isEmpty())
+      {
+        auto pending = mPending.dequeue();
+        --mInFlight[pending.priority];
+        // A reply of the wrong kind, such as an error, leaves it without
+        // a result.
+        pending.promise.reportFinished();
+        mStats.recordReply(pending.type,
+                           (mClock.nsecsElapsed() - pending.sentAt) / 1000,
+                           frameSize, parseNs / 1000, handlerNs / 1000);
+        if (isCachedRequest(pending.type))
           {
-            auto bs = obj["content_diff"].toObject();
-            handleDiffContent(bs);
+            mResults->insertReply(pending.generation, pending.frame, payload);
           }
-        else if (obj.contains("target_info"))
+      }
+  }
+  pumpRequests();
+  if (mHibernateTimer->interval() > 0 && mDaemon)
+    {
+      mHibernateTimer->start();
+    }
+}
+
+CMakeClient::PendingRequest CMakeClient::headRequest() const
+{
+  if (!mPending.isEmpty())
+    {
+      return mPending.head();
+    }
+  PendingRequest unsolicited;
+  unsolicited.generation = mGeneration;
+  return unsolicited;
+}
+
+void CMakeClient::clearDataBuffer()
+{
+  mDataBuffer.clear();
+  mReplyDecoder->reset();
+  mArrivedCount = 0;
+}
+
+void CMakeClient::decodePartialReply()
+{
+  // ReplyDecoder reads JSON text only; a CBOR reply is decoded whole, as a
+  // document, once its frame is complete.
+  if (mWireFormat != JsonWire || mReplyDecoder->kind() == ReplyDecoder::Other
+      || (!mPending.isEmpty() && mPending.head().generation != mGeneration))
+    {
+      return;
+    }
+  int startPoint = mDataBuffer.indexOf(MAGIC_START);
+  if (startPoint == -1)
+    {
+      return;
+    }
+  startPoint += sizeof(MAGIC_START) - 1;
+  // Leave out what may be the start of the end marker.
+  int size = mDataBuffer.size() - startPoint - int(sizeof(MAGIC_END) - 1);
+  if (size < partialDecodeThreshold)
+    {
+      return;
+    }
+  {
+    CMK_TRACE_SCOPE("client", "partial parse");
+    mReplyDecoder->feed(mDataBuffer.constData() + startPoint, size);
+  }
+
+  mReply = headRequest();
+  if (mReplyDecoder->kind() == ReplyDecoder::Buildsystem
+      && mReplyDecoder->targets().size() > mArrivedCount)
+    {
+      auto const& targets = mReplyDecoder->targets();
+      Q_EMIT targetsArriving(targets.mid(mArrivedCount));
+      mArrivedCount = targets.size();
+    }
+  // The tokens of a parse reply are not shown as they arrive; decoding
+  // them early only leaves less to do once the reply is complete.
+}
+
+qint64 CMakeClient::takeFrame(QByteArray* payload, bool* bulk)
+{
+  *bulk = false;
+  int startPoint = mDataBuffer.indexOf(MAGIC_START);
+  // Binary and bulk frames carry a length instead of an end marker.
+  int lengthStart = -1;
+  int headerSize = 0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (mWireFormat == CborWire)
+    {
+      lengthStart = mDataBuffer.indexOf(MAGIC_START_CBOR);
+      headerSize = sizeof(MAGIC_START_CBOR) - 1 + 4;
+    }
+#endif
+  if (mDaemon && mDaemon->hasBulkChannel())
+    {
+      int bulkStart = mDataBuffer.indexOf(MAGIC_START_BULK);
+      if (bulkStart != -1 && (lengthStart == -1 || bulkStart < lengthStart))
+        {
+          lengthStart = bulkStart;
+          headerSize = sizeof(MAGIC_START_BULK) - 1 + 4;
+          *bulk = true;
+        }
+    }
+  if (lengthStart != -1 && (startPoint == -1 || lengthStart < startPoint))
+    {
+      if (mDataBuffer.size() - lengthStart < headerSize)
+        {
+          return 0;
+        }
+      auto length = qFromLittleEndian<quint32>(
+            reinterpret_cast<const uchar*>(mDataBuffer.constData())
+            + lengthStart + headerSize - 4);
+      if (*bulk)
+        {
+          *payload = mDaemon->bulkPayload(length);
+          mDataBuffer = mDataBuffer.mid(lengthStart + headerSize);
+          return headerSize + qint64(length);
+        }
+      if (quint32(mDataBuffer.size() - lengthStart - headerSize) < length)
+        {
+          return 0;
+        }
+      *payload = mDataBuffer.mid(lengthStart + headerSize, length);
+      mDataBuffer = mDataBuffer.mid(lengthStart + headerSize + length);
+      return headerSize + qint64(length);
+    }
+  *bulk = false;
+  int endPoint = 0;
+  int payloadStart = findTextFrame(mDataBuffer, qMax(startPoint, 0), &endPoint);
+  if (payloadStart == -1)
+    {
+      return 0;
+    }
+  qint64 frameSize = endPoint + sizeof(MAGIC_END) - 1 - startPoint;
+  *payload = mDataBuffer.mid(payloadStart, endPoint - payloadStart);
+  mDataBuffer = mDataBuffer.right(mDataBuffer.size() - endPoint - sizeof(MAGIC_END) + 1);
+  return frameSize;
+}
+
+CMakeClient::WireFormat CMakeClient::wireFormat() const
+{
+  return mWireFormat;
+}
+
+bool CMakeClient::isCachedRequest(const QString& type)
+{
+  return type == QLatin1String("buildsystem")
+      || type == QLatin1String("target_info");
+}
+
+void CMakeClient::setHibernateTimeout(int msecs)
+{
+  mHibernateTimer->setInterval(msecs);
+  if (msecs > 0 && mDaemon)
+    {
+      mHibernateTimer->start();
+    }
+  else
+    {
+      mHibernateTimer->stop();
+    }
+}
+
+bool CMakeClient::isHibernating() const
+{
+  return mHibernating;
+}
+
+void CMakeClient::hibernate()
+{
+  if (!mDaemon || mRecovering || mState != Idle)
+    {
+      return;
+    }
+  if (pendingRequests() > 0)
+    {
+      mHibernateTimer->start();
+      return;
+    }
+  qDebug() << "HIBERNATE" << mBuildDir;
+  stopDaemon(mDaemon);
+  clearDataBuffer();
+  mHibernating = true;
+}
+
+void CMakeClient::revive()
+{
+  qDebug() << "REVIVE" << mBuildDir;
+  mHibernating = false;
+  mRecovering = true;
+  mHandshakeSent = false;
+  attachDaemon(spawnDaemon(mCMakeExe, mBuildDir));
+}
+
+void CMakeClient::replyFromCache(const QByteArray& frame,
+                                 const QString& config)
+{
+  auto cached = mResults->reply(frame);
+  if (cached.isNull())
+    {
+      return;
+    }
+  QJsonObject reply;
+  if (decodeReply(cached, &reply))
+    {
+      CMK_TRACE_SCOPE("client", "handle cached");
+      // Only the live reply, which follows, answers the request's future.
+      mReply = PendingRequest();
+      mReply.config = config;
+      mReply.generation = mGeneration;
+      dispatchReply(reply);
+      mReply = PendingRequest();
+    }
+}
+
+DaemonTransport* CMakeClient::spawnDaemon(const QString& cmakeExe,
+                                          const QString& buildDir)
+{
+  DaemonTransport* daemon = nullptr;
+  if (mBulkChannel)
+    {
+      daemon = new SharedMemoryTransport(64 * 1024 * 1024, this);
+    }
+  else
+    {
+      daemon = new PipeTransport(this);
+    }
+  daemon->start(cmakeExe, buildDir);
+  return daemon;
+}
+
+void CMakeClient::stopDaemon(DaemonTransport*& daemon)
+{
+  if (daemon)
+    {
+      // The daemon may be stopped from one of its own signals.
+      disconnect(daemon, nullptr, this, nullptr);
+      daemon->deleteLater();
+      daemon = nullptr;
+    }
+}
+
+void CMakeClient::attachDaemon(DaemonTransport* daemon)
+{
+  mDaemon = daemon;
+  // Each daemon agrees on its own encoding at handshake.
+  mWireFormat = JsonWire;
+  connect(mDaemon, &DaemonTransport::readyRead, this, [this] {
+      auto newBit = mDaemon->readAll();
+      mDataBuffer += newBit;
+      static const auto stdoutSignal =
+          QMetaMethod::fromSignal(&CMakeClient::stdoutReceieved);
+      if (isSignalConnected(stdoutSignal))
+        {
+          Q_EMIT stdoutReceieved(QString::fromUtf8(newBit));
+        }
+      processServerData();
+    });
+  connect(mDaemon, &DaemonTransport::bytesWritten,
+          this, &CMakeClient::pumpRequests);
+  connect(mDaemon, &DaemonTransport::finished,
+          this, [this](int exitCode, bool crashed) {
+      if (crashed || exitCode != 0)
+        {
+          recoverDaemon();
+          return;
+        }
+      // The daemon quit by itself; restarting it would not help.
+      qDebug() << "SERVER EXITED" << mBuildDir;
+      stopDaemon(mDaemon);
+      clearDataBuffer();
+      daemonGone();
+    });
+  connect(mDaemon, &DaemonTransport::failedToStart,
+          this, &CMakeClient::recoverDaemon);
+}
+
+void CMakeClient::recoverDaemon()
+{
+  stopDaemon(mDaemon);
+  clearDataBuffer();
+
+  if (++mRestartCount > maxRestarts)
+    {
+      qDebug() << "SERVER GONE" << mBuildDir;
+      daemonGone();
+      return;
+    }
+
+  // The outstanding requests are written again once the new daemon is
+  // idle; requests made in the meantime are queued behind them.
+  qDebug() << "RESTART" << mBuildDir;
+  mHibernateTimer->stop();
+  mRecovering = true;
+  mHandshakeSent = false;
+  attachDaemon(spawnDaemon(mCMakeExe, mBuildDir));
+}
+
+void CMakeClient::daemonGone()
+{
+  clearRequests();
+  mRecovering = false;
+  mState = NotRunning;
+  Q_EMIT stateChanged();
+}
+
+void CMakeClient::prestart(const QString& cmakeExe, const QString& buildDir)
+{
+  if (mDaemon && mBuildDir == buildDir && mCMakeExe == cmakeExe)
+    {
+      return;
+    }
+  stopDaemon(mStandbyDaemon);
+  mStandbyBuffer.clear();
+  mStandbyScanned = 0;
+  mStandbyHandshakeSent = false;
+  mStandbyCMakeExe = cmakeExe;
+  mStandbyBuildDir = buildDir;
+  mStandbyDaemon = spawnDaemon(cmakeExe, buildDir);
+
+  // The standby configures in the background and keeps everything it says
+  // until start() adopts it.
+  connect(mStandbyDaemon, &DaemonTransport::readyRead, this, [this] {
+      mStandbyBuffer += mStandbyDaemon->readAll();
+      if (!mStandbyHandshakeSent && standbyProcessStarted())
+        {
+          mStandbyHandshakeSent = true;
+          mStandbyDaemon->write(handshakeFrame, sizeof(handshakeFrame) - 1);
+        }
+    });
+  auto dropStandby = [this] {
+      stopDaemon(mStandbyDaemon);
+      mStandbyBuffer.clear();
+    };
+  connect(mStandbyDaemon, &DaemonTransport::finished, this, dropStandby);
+  connect(mStandbyDaemon, &DaemonTransport::failedToStart, this, dropStandby);
+}
+
+bool CMakeClient::standbyProcessStarted()
+{
+  // Frames are looked at once each; the standby speaks JSON until its
+  // handshake.
+  Q_FOREVER {
+    int payloadEnd = 0;
+    int payloadStart = findTextFrame(mStandbyBuffer, mStandbyScanned,
+                                     &payloadEnd);
+    if (payloadStart == -1)
+      {
+        return false;
+      }
+    mStandbyScanned = payloadEnd + int(sizeof(MAGIC_END) - 1);
+    QJsonObject reply;
+    if (decodeReply(mStandbyBuffer.mid(payloadStart, payloadEnd - payloadStart),
+                    &reply)
+        && reply.value("progress").toString()
+            == QLatin1String("process-started"))
+      {
+        return true;
+      }
+  }
+}
+
+void CMakeClient::start(QString const& cmakeExe, QString const& buildDir)
+{
+  if (mDaemon)
+  {
+    qDebug() << "TERM OLD" << mBuildDir;
+    stopDaemon(mDaemon);
+  }
+
+  qDebug() << "START" << buildDir;
+  clearRequests();
+  clearDataBuffer();
+  mCMakeExe = cmakeExe;
+  mBuildDir = buildDir;
+  mRestartCount = 0;
+  mRecovering = false;
+  mVerifyBuildsystem = false;
+  mHibernating = false;
+  advanceGeneration();
+  if (mHibernateTimer->interval() > 0)
+    {
+      mHibernateTimer->start();
+    }
+
+  if (mStandbyDaemon && mStandbyBuildDir == buildDir
+      && mStandbyCMakeExe == cmakeExe)
+    {
+      // Adopt the warm daemon and catch up on what it has said so far.
+      auto daemon = mStandbyDaemon;
+      disconnect(daemon, nullptr, this, nullptr);
+      mStandbyDaemon = nullptr;
+      mHandshakeSent = mStandbyHandshakeSent;
+      mDataBuffer = mStandbyBuffer + daemon->readAll();
+      mStandbyBuffer.clear();
+      attachDaemon(daemon);
+      processServerData();
+      return;
+    }
+
+  mHandshakeSent = false;
+  attachDaemon(spawnDaemon(cmakeExe, buildDir));
+}
+
+void CMakeClient::startOffline()
+{
+  if (mDaemon)
+    {
+      qDebug() << "TERM OLD" << mBuildDir;
+      stopDaemon(mDaemon);
+    }
+  mRecovering = false;
+  mVerifyBuildsystem = false;
+  mHibernating = false;
+  mHibernateTimer->stop();
+  advanceGeneration();
+  mCMakeExe.clear();
+  mBuildDir.clear();
+  mSourceDir.clear();
+  mProjectName.clear();
+  clearRequests();
+  clearDataBuffer();
+  mWireFormat = JsonWire;
+  mState = NotRunning;
+  Q_EMIT stateChanged();
+}
+
+void CMakeClient::replayReply(const QByteArray& payload)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (isCborPayload(payload))
+    {
+      uchar length[4];
+      qToLittleEndian<quint32>(payload.size(), length);
+      mWireFormat = CborWire;
+      mDataBuffer += MAGIC_START_CBOR;
+      mDataBuffer.append(reinterpret_cast<const char*>(length), 4);
+      mDataBuffer += payload;
+      processServerData();
+      return;
+    }
+#endif
+  mDataBuffer += MAGIC_START;
+  mDataBuffer += payload;
+  mDataBuffer += MAGIC_END;
+  processServerData();
+}
+
+void CMakeClient::setBulkChannel(bool enabled)
+{
+  mBulkChannel = enabled;
+}
+
+void CMakeClient::setRecorder(ProtocolRecorder* recorder)
+{
+  mRecorder = recorder;
+}
+
+CMakeClient::Priority CMakeClient::priorityOf(const QString& type)
+{
+  return type == QLatin1String("target_info") ? Bulk : Interactive;
+}
+
+void CMakeClient::setInFlightLimit(Priority priority, int limit)
+{
+  mInFlightLimit[priority] = qMax(1, limit);
+  pumpRequests();
+}
+
+void CMakeClient::clearRequests()
+{
+  for (auto& pending : mPending)
+    {
+      cancelRequest(pending);
+    }
+  mPending.clear();
+  for (int i = 0; i < NumPriorities; ++i)
+    {
+      for (auto& queued : mQueued[i])
+        {
+          cancelRequest(queued);
+        }
+      mQueued[i].clear();
+      mInFlight[i] = 0;
+    }
+}
+
+void CMakeClient::cancelRequest(PendingRequest& request)
+{
+  request.promise.cancel();
+  request.promise.reportFinished();
+}
+
+void CMakeClient::pumpRequests()
+{
+  // The daemon answers in the order it was written to, so anything
+  // written is ahead of every later request.  Holding back all but a few
+  // bulk requests lets interactive ones overtake the rest.
+  if (mRecovering)
+    {
+      return;
+    }
+  Q_FOREVER {
+    auto now = mClock.nsecsElapsed();
+    int next = -1;
+    for (int i = 0; i < NumPriorities; ++i)
+      {
+        // Nobody waits for a cancelled request any more.
+        while (!mQueued[i].isEmpty() && mQueued[i].head().promise.isCanceled())
           {
-            auto bs = obj["target_info"].toObject();
-            handleSources(bs);
+            mQueued[i].head().promise.reportFinished();
+            mQueued[i].dequeue();
           }
-        else if (obj.contains("parsed"))
+        if (mQueued[i].isEmpty() || mInFlight[i] >= mInFlightLimit[i])
           {
-            auto parsed = obj["parsed"].toObject();
-            auto unr = parsed["unreachable"].toArray();
-            auto tokens = parsed["tokens"].toArray();
-            handleParsed(unr, tokens);
+            continue;
           }
-        else if (obj.contains("contextual_help"))
+        if (next == -1)
           {
-            auto unr = obj["contextual_help"].toObject();
-            if (!unr.contains("nocontext")) {
-                Q_EMIT contextualHelpRetrieved(
-                      unr["context"].toString(),
-                    unr["help_key"].toString());
-              }
+            next = i;
           }
-        else if (obj.contains("completion"))
+        // A request that waited too long goes first whatever its class.
+        if (now - mQueued[i].head().queuedAt > agingLimitNs)
           {
-            auto unr = obj["completion"].toObject();
-            if (unr.contains("result") && unr["result"] == "no_completions")
-              {
-                qDebug() << "NO COMPLETIONS";
-                return;
-              }
-            QString matcher = unr["matcher"].toString();
-            QJsonArray results;
-            if (unr.contains("targets"))
-              {
-                results = unr["targets"].toArray();
-              }
-            if (unr.contains("commands"))
-              {
-                results = unr["commands"].toArray();
-              }
-            if (unr.contains("variables"))
-              {
-                results = unr["variables"].toArray();
-              }
-            if (unr.contains("packages"))
-              {
-                results = unr["packages"].toArray();
-              }
-            if (unr.contains("modules"))
-              {
-                results = unr["modules"].toArray();
-              }
-            if (unr.contains("policies"))
-              {
-                results = unr["policies"].toArray();
-              }
-            if (unr.contains("keywords"))
-              {
-                results = unr["keywords"].toArray();
-              }
-
-            QStringList descriptions;
-            if (unr.contains("descriptions"))
-              {
-              auto descr = unr["descriptions"].toArray();
-              foreach(auto res, descr)
-                {
-                descriptions.push_back(res.toString());
-                }
-              }
-            QStringList strings;
-            foreach(auto res, results)
-              {
-                strings.push_back(res.toString());
-              }
-            completionsRetrieved(matcher, strings, descriptions);
+            next = i;
+            break;
           }
+      }
+    if (next == -1)
+      {
+        return;
+      }
+    // Leave the rest queued, where it can still be superseded, until the
+    // daemon has drained the pipe.
+    if (mDaemon && mDaemon->bytesToWrite() >= maxBytesToWrite)
+      {
+        return;
+      }
+    writeRequest(mQueued[next].dequeue());
+  }
+}
+
+void CMakeClient::setSupersedeRequests(bool supersede)
+{
+  mSupersede = supersede;
+}
+
+bool CMakeClient::supersedeQueued(const PendingRequest& request)
+{
+  if (request.supersedeKey.isEmpty())
+    {
+      return false;
+    }
+  auto& queue = mQueued[request.priority];
+  for (auto it = queue.begin(); it != queue.end(); ++it)
+    {
+      // A cancelled request is dropped when it comes up, and must not
+      // take its successor with it.
+      if (it->supersedeKey == request.supersedeKey
+          && !it->promise.isCanceled())
+        {
+          // Keep the place in the queue, and the age, of the request
+          // being replaced; everything else is the newer request's.
+          mStats.recordSuperseded(it->type);
+          cancelRequest(*it);
+          it->subject = request.subject;
+          it->config = request.config;
+          it->generation = request.generation;
+          it->frame = request.frame;
+          it->promise = request.promise;
+          return true;
         }
-    };
+    }
+  return false;
+}
 
-  connect(mServerProcess, &QProcess::readyReadStandardOutput, [this, handleServerData] {
-      auto newBit = mServerProcess->readAll();
-      mDataBuffer += newBit;
-      Q_EMIT stdoutReceieved(newBit);
-      handleServerData();
-    });
-  connect(mServerProcess,
-          SELECT<QProcess::ProcessError>::OVERLOAD_OF(&QProcess::error),
-          [this](QProcess::ProcessError error) {
-      qDebug() << "SERVER ERROR" << error;
-    });
-  connect(mServerProcess, SELECT<int>::OVERLOAD_OF(&QProcess::finished), [this] {
-      qDebug() << "SERVER GONE";
-    });
-  mServerProcess->setWorkingDirectory(buildDir);
-  mServerProcess->start(cmakeExe + " -E daemon " + buildDir, QProcess::ReadWrite);
+void CMakeClient::writeRequest(PendingRequest request)
+{
+  if (mDaemon)
+    {
+      CMK_TRACE_SCOPE("client", "write");
+      mDaemon->write(request.frame);
+    }
+  static const auto stdinSignal =
+      QMetaMethod::fromSignal(&CMakeClient::stdinWritten);
+  if (isSignalConnected(stdinSignal))
+    {
+      Q_EMIT stdinWritten(QString::fromUtf8(request.frame));
+    }
+  request.sentAt = mClock.nsecsElapsed();
+  ++mInFlight[request.priority];
+  mPending.enqueue(request);
 }
 
-void CMakeClient::makeRequest(QJsonObject const& obj)
+JsonWriter& CMakeClient::beginRequest(QLatin1String type)
 {
-  QJsonDocument body(obj);
-  QByteArray request;
-  request += MAGIC_START;
-  request += body.toJson();
-  request += MAGIC_END;
-  mServerProcess->write(request);
-  Q_EMIT stdinWritten(request);
+  mRequestType = type;
+  mRequestWriter.clear();
+  mRequestWriter.appendRaw(MAGIC_START, sizeof(MAGIC_START) - 1);
+  mRequestWriter.beginObject();
+  mRequestWriter.field(QLatin1String("type"), type);
+  return mRequestWriter;
+}
+
+QFutureInterfaceBase CMakeClient::makeRequest(const QString& subject,
+                                              const QString& config)
+{
+  CMK_TRACE_SCOPE("client", "enqueue request");
+  mRequestWriter.endObject();
+  mRequestWriter.appendRaw(MAGIC_END, sizeof(MAGIC_END) - 1);
+  // The writer keeps its buffer for the next request; the queue gets a copy
+  // of exactly the frame.
+  auto const& data = mRequestWriter.data();
+  QByteArray request(data.constData(), data.size());
+  recordRequest(request);
+
+  auto const& type = mRequestType;
+  mStats.recordRequest(type, request.size(), pendingRequests());
+  PendingRequest pending;
+  pending.type = type;
+  pending.subject = subject;
+  pending.config = config;
+  pending.generation = mGeneration;
+  pending.supersedeKey =
+      mSupersede ? supersedeKey(type, subject, config) : QString();
+  pending.priority = priorityOf(type);
+  pending.queuedAt = mClock.nsecsElapsed();
+  pending.sentAt = pending.queuedAt;
+  pending.frame = request;
+  pending.promise.reportStarted();
+  if (!supersedeQueued(pending))
+    {
+      mQueued[pending.priority].enqueue(pending);
+    }
+
+  // Until the daemon is back, answer what can be answered from the
+  // replies it gave before; the live reply follows once it is idle.
+  if (mHibernating)
+    {
+      revive();
+    }
+  if (mRecovering)
+    {
+      replyFromCache(request, pending.config);
+    }
+  pumpRequests();
+  return pending.promise;
+}
+
+void CMakeClient::recordRequest(const QByteArray& frame)
+{
+  if (mRecorder)
+    {
+      mRecorder->record(ProtocolRecorder::Request,
+                        frame.constData() + sizeof(MAGIC_START) - 1,
+                        int(frame.size() - sizeof(MAGIC_START) - sizeof(MAGIC_END) + 2));
+    }
 }
 
 void CMakeClient::writeHandshake()
 {
-  QJsonObject obj;
-  obj["type"] = "handshake";
-  makeRequest(obj);
+  mHandshakeSent = true;
+  QByteArray request(handshakeFrame, sizeof(handshakeFrame) - 1);
+  recordRequest(request);
+  // Not answered, so not queued either.
+  if (mDaemon)
+    {
+      mDaemon->write(request);
+    }
 }
 
-void CMakeClient::retrieveTargets()
+QFuture<CMakeBuildsystem> CMakeClient::retrieveTargets()
 {
-  QJsonObject obj;
-  obj["type"] = "buildsystem";
+  beginRequest(QLatin1String("buildsystem"));
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeBuildsystem>(makeRequest()).future();
 }
 
-void CMakeClient::retrieveContent(long line, const QString& filePath,
-                                  const QString& fileContent)
+QFuture<QMap<QString, QString> > CMakeClient::retrieveContent(
+    long line, const QString& filePath, const QString& fileContent)
 {
-  QJsonObject obj;
-  obj["type"] = "content";
-  obj["file_path"] = filePath;
-  obj["file_line"] = (int)line;
-  obj["file_content"] = fileContent;
+  auto& writer = beginRequest(QLatin1String("content"));
+  writer.field(QLatin1String("file_path"), filePath);
+  writer.field(QLatin1String("file_line"), (int)line);
+  writer.field(QLatin1String("file_content"), fileContent);
 
-  makeRequest(obj);
+  return QFutureInterface<QMap<QString, QString> >(
+        makeRequest(filePath)).future();
 }
 
-void CMakeClient::retrieveDiffContent(long line1, const QString& filePath1,
-                                      long line2, const QString& filePath2,
-                                      const QString& fileContent)
+QFuture<CMakeDiffContent> CMakeClient::retrieveDiffContent(
+    long line1, const QString& filePath1,
+    long line2, const QString& filePath2,
+    const QString& fileContent)
 {
-  QJsonObject obj;
-  obj["type"] = "content_diff";
-  obj["file_path1"] = filePath1;
-  obj["file_line1"] = (int)line1;
-  obj["file_content1"] = fileContent;
-  obj["file_path2"] = filePath2;
-  obj["file_line2"] = (int)line2;
-  obj["file_content2"] = fileContent;
+  auto& writer = beginRequest(QLatin1String("content_diff"));
+  writer.field(QLatin1String("file_path1"), filePath1);
+  writer.field(QLatin1String("file_line1"), (int)line1);
+  writer.field(QLatin1String("file_content1"), fileContent);
+  writer.field(QLatin1String("file_path2"), filePath2);
+  writer.field(QLatin1String("file_line2"), (int)line2);
+  writer.field(QLatin1String("file_content2"), fileContent);
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeDiffContent>(makeRequest(filePath1)).future();
 }
 
-void CMakeClient::retrieveParsed(const QString& filePath,
-                                 const QString& content)
+QFuture<CMakeParseResult> CMakeClient::retrieveParsed(
+    const QString& filePath, const QString& content)
 {
-  QJsonObject obj;
-  obj["type"] = "parse";
-  obj["file_path"] = filePath;
+  auto& writer = beginRequest(QLatin1String("parse"));
+  writer.field(QLatin1String("file_path"), filePath);
   if (!content.isEmpty())
     {
-    obj["file_content"] = content;
+    writer.field(QLatin1String("file_content"), content);
     }
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeParseResult>(makeRequest(filePath)).future();
 }
 
-void CMakeClient::retrieveContextualHelp(const QString& filePath,
-                                         int line, int column,
-                                         const QString& fileContent)
+QFuture<CMakeContextualHelp> CMakeClient::retrieveContextualHelp(
+    const QString& filePath, int line, int column,
+    const QString& fileContent)
 {
-  QJsonObject obj;
-  obj["type"] = "contextual_help";
-  obj["file_path"] = filePath;
-  obj["line"] = line;
-  obj["column"] = column;
-  obj["file_content"] = fileContent;
+  auto& writer = beginRequest(QLatin1String("contextual_help"));
+  writer.field(QLatin1String("file_path"), filePath);
+  writer.field(QLatin1String("line"), line);
+  writer.field(QLatin1String("column"), column);
+  writer.field(QLatin1String("file_content"), fileContent);
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeContextualHelp>(
+        makeRequest(filePath)).future();
 }
 
-void CMakeClient::retrieveSources(const QString& targetName)
+QFuture<CMakeTargetInfo> CMakeClient::retrieveSources(
+    const QString& targetName, const QString& config)
 {
-  QJsonObject obj;
-  obj["type"] = "target_info";
-  obj["target_name"] = targetName;
-  obj["config"] = QString();
+  auto& writer = beginRequest(QLatin1String("target_info"));
+  writer.field(QLatin1String("target_name"), targetName);
+  writer.field(QLatin1String("config"), config);
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeTargetInfo>(
+        makeRequest(targetName, config)).future();
 }
 
-void CMakeClient::retrieveCompletions(long line, long column,
-                                      const QString& filePath,
-                                      const QString& fileContent)
+QFuture<CMakeCompletions> CMakeClient::retrieveCompletions(
+    long line, long column, const QString& filePath,
+    const QString& fileContent)
 {
-  QJsonObject obj;
-  obj["type"] = "code_complete";
-  obj["file_path"] = filePath;
-  obj["file_line"] = (int)line;
-  obj["file_column"] = (int)column;
-  obj["file_content"] = fileContent;
+  auto& writer = beginRequest(QLatin1String("code_complete"));
+  writer.field(QLatin1String("file_path"), filePath);
+  writer.field(QLatin1String("file_line"), (int)line);
+  writer.field(QLatin1String("file_column"), (int)column);
+  writer.field(QLatin1String("file_content"), fileContent);
 
-  makeRequest(obj);
+  return QFutureInterface<CMakeCompletions>(makeRequest(filePath)).future();
 }
 
 CMakeTarget::TargetType CMakeTarget::typeFromString(const QString& ts)
@@ -19,12 +19,25 @@
 
 #pragma once
 
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QQueue>
+#include <QStringList>
 #include <QVector>
 
+#include "jsonwriter.h"
+#include "requeststats.h"
 #include "utility.h"
 
-class QProcess;
+class QTimer;
+class DaemonTransport;
+class ProtocolRecorder;
+class ReplyDecoder;
+class ResultsStore;
 
 struct CMakeTarget
 {
@@ -37,9 +50,11 @@ struct CMakeTarget
   QString Path;
   QString ProjectName;
   QVector<QPair<QString, int> > Backtrace;
-  TargetType Type;
+  // Names of the targets this one links to.
+  QStringList Dependencies;
+  TargetType Type = UNKNOWN_LIBRARY;
 
-  uint Line;
+  uint Line = 0;
 
 //#define DECLARE_MEMBER(NAME) QStringList NAME;
 //  CMB_FOR_EACH_SOURCE_TYPE(DECLARE_MEMBER)
@@ -59,7 +74,8 @@ inline bool operator==(const CMakeTarget& lhs, const CMakeTarget& rhs)
 //#undef COMPARE_MEMBER
        lhs.Name == rhs.Name
     && lhs.Path == rhs.Path
-    && lhs.Type == rhs.Type;
+    && lhs.Type == rhs.Type
+    && lhs.Dependencies == rhs.Dependencies;
 }
 
 inline bool operator!=(const CMakeTarget& lhs, const CMakeTarget& rhs)
@@ -67,6 +83,63 @@ inline bool operator!=(const CMakeTarget& lhs, const CMakeTarget& rhs)
   return !(lhs == rhs);
 }
 
+struct CMakeTargetInfo
+{
+  QString Name;
+  QString Config;
+  QStringList Sources;
+  QStringList GeneratedSources;
+  QStringList IncludeDirectories;
+  QStringList CompileDefinitions;
+};
+
+inline bool operator==(const CMakeTargetInfo& lhs, const CMakeTargetInfo& rhs)
+{
+  return lhs.Name == rhs.Name
+      && lhs.Config == rhs.Config
+      && lhs.Sources == rhs.Sources
+      && lhs.GeneratedSources == rhs.GeneratedSources
+      && lhs.IncludeDirectories == rhs.IncludeDirectories
+      && lhs.CompileDefinitions == rhs.CompileDefinitions;
+}
+
+inline bool operator!=(const CMakeTargetInfo& lhs, const CMakeTargetInfo& rhs)
+{
+  return !(lhs == rhs);
+}
+
+struct CMakeBuildsystem
+{
+  QStringList Configs;
+  QVector<CMakeTarget> Targets;
+};
+
+inline bool operator==(const CMakeBuildsystem& lhs,
+                       const CMakeBuildsystem& rhs)
+{
+  return lhs.Configs == rhs.Configs && lhs.Targets == rhs.Targets;
+}
+
+struct CMakeDiffContent
+{
+  QMap<QString, QString> Added;
+  QMap<QString, QString> Removed;
+};
+
+struct CMakeContextualHelp
+{
+  QString Context;
+  QString Key;
+};
+
+struct CMakeCompletions
+{
+  QString Matcher;
+  QStringList Results;
+  QStringList Descriptions;
+  QString Kind;
+};
+
 enum TokenType {
   Command,
   UserCommand,
@@ -94,6 +167,12 @@ inline bool operator!=(const Fragment& lhs, const Fragment& rhs)
   return !(lhs == rhs);
 }
 
+struct CMakeParseResult
+{
+  QMap<int, int> Unreachable;
+  QVector<Fragment> Fragments;
+};
+
 class CMakeClient : public QObject
 {
   Q_OBJECT
@@ -112,26 +191,96 @@ public:
   QString buildDir() const;
   QString sourceDir() const;
   QString projectName() const;
+  QString cmakeExecutable() const;
+
+  // Interactive requests are written ahead of queued bulk ones; each
+  // class has a limit on the requests written but not yet answered.
+  enum Priority {
+    Interactive,
+    Bulk,
+    NumPriorities
+  };
+
+  // The encoding of the daemon's replies.  Requests are always JSON; with
+  // Qt 5.12 or later CBOR replies are offered at handshake, and used if
+  // the daemon accepts.
+  enum WireFormat {
+    JsonWire,
+    CborWire
+  };
+
+  WireFormat wireFormat() const;
+
+  static Priority priorityOf(const QString& type);
+  void setInFlightLimit(Priority priority, int limit);
+
+  // Whether a request still queued is replaced by a newer one asking the
+  // same of the same file or target, rather than both being sent.  Only
+  // the newer one is answered.  On by default.
+  void setSupersedeRequests(bool supersede);
+
+  // Counts the configurations of the build: it advances on start(),
+  // startOffline() and whenever the daemon configures the build again.  A
+  // reply to a request made in an earlier generation is dropped unread,
+  // and its future cancelled.
+  quint32 generation() const;
+  // What the replies of the current generation said.
+  const ResultsStore& results() const;
+
+  const RequestStats& stats() const;
+  void clearStats();
+  int pendingRequests() const;
 
   CMakeClient(QObject* parent = nullptr);
+  ~CMakeClient();
 
   void start(const QString& cmakeExe, const QString& buildDir);
 
-  void retrieveTargets();
-  void retrieveContent(long line, QString const& filePath,
-                       const QString& fileContent);
-  void retrieveDiffContent(long line1, QString const& filePath1,
-                           long line2, QString const& filePath2,
-                           const QString& fileContent);
-  void retrieveParsed(QString const& filePath, const QString& content = {});
-  void retrieveContextualHelp(const QString& filePath,
-                              int line, int column,
-                              const QString& fileContent);
-  void retrieveSources(QString const& targetName);
-
-  void retrieveCompletions(long line, long column,
-                           QString const& filePath,
-                           const QString& fileContent);
+  // Launches a standby daemon which configures in the background.  A later
+  // start() with the same arguments adopts it instead of starting afresh.
+  void prestart(const QString& cmakeExe, const QString& buildDir);
+
+  // Detaches from any daemon; replies are then supplied with replayReply().
+  void startOffline();
+  void replayReply(const QByteArray& payload);
+
+  // Stops the daemon after msecs without traffic; 0 never hibernates.  A
+  // hibernated client still reports Idle.  The next request starts a new
+  // daemon and is answered from the previous replies while it configures.
+  void setHibernateTimeout(int msecs);
+  bool isHibernating() const;
+
+  // Whether daemons started from now on are also given a shared memory
+  // segment to hand large replies over in; see SharedMemoryTransport.
+  // Off by default.
+  void setBulkChannel(bool enabled);
+
+  // Records framed traffic; the recorder is not owned.
+  void setRecorder(ProtocolRecorder* recorder);
+
+  // Each request's future gets the result of its reply, which is also
+  // broadcast by the signals below.  Cancelling a future drops the request
+  // if it is still queued; a request superseded by a newer one, or
+  // outstanding when the daemon is stopped, is cancelled.  See futures.h
+  // for combining them.
+  QFuture<CMakeBuildsystem> retrieveTargets();
+  QFuture<QMap<QString, QString> > retrieveContent(
+      long line, QString const& filePath, const QString& fileContent);
+  QFuture<CMakeDiffContent> retrieveDiffContent(
+      long line1, QString const& filePath1,
+      long line2, QString const& filePath2,
+      const QString& fileContent);
+  QFuture<CMakeParseResult> retrieveParsed(QString const& filePath,
+                                           const QString& content = {});
+  QFuture<CMakeContextualHelp> retrieveContextualHelp(
+      const QString& filePath, int line, int column,
+      const QString& fileContent);
+  QFuture<CMakeTargetInfo> retrieveSources(QString const& targetName,
+                                           QString const& config = QString());
+
+  QFuture<CMakeCompletions> retrieveCompletions(long line, long column,
+                                                QString const& filePath,
+                                                const QString& fileContent);
 
 Q_SIGNALS:
   void errorReported();
@@ -147,34 +296,156 @@ Q_SIGNALS:
                             QMap<QString, QString> const& removedMap);
   void parsedRetrieved(QMap<int, int> const& unreachableMap,
                        QVector<Fragment> const& fragments);
+  // The next targets of a large buildsystem reply which is still
+  // arriving.  targetsRetrieved follows with all of them once the reply is
+  // complete.  Only JSON replies are decoded as they arrive; with CBOR
+  // negotiated, the whole reply is decoded once it is complete.
+  void targetsArriving(QVector<CMakeTarget> const& targets);
   void contextualHelpRetrieved(const QString& helpContext,
                                const QString& helpKey);
   void completionsRetrieved(const QString& matcher,
                             const QStringList& results,
-                            const QStringList& descriptions);
+                            const QStringList& descriptions,
+                            const QString& kind);
   void sourcesRetrieved(const QString& tgtName,
                         const QStringList& srcs,
                         const QStringList& genSrcs);
   void includesRetrieved(const QStringList& incs);
   void definesRetrieved(const QStringList& incs);
+  void targetInfoRetrieved(const CMakeTargetInfo& info);
 
   void sourceDirChanged();
+  void generationChanged();
 
 private:
+  struct ReplyHandler;
+  static const QHash<quint32, ReplyHandler>& replyHandlers();
+
+  void processServerData();
+  bool dispatchReply(const QJsonObject& reply);
+
+  void handleProgress(const QJsonObject& obj);
+  void handleCompletion(const QJsonObject& completion);
   void handleBuildsystemData(const QJsonObject& bs);
   void handleContent(const QJsonObject& bs);
   void handleDiffContent(const QJsonObject& bs);
   void handleParsed(const QJsonArray& unr, const QJsonArray& tok);
   void handleSources(const QJsonObject& tgtInfo);
 
-  void makeRequest(QJsonObject const& obj);
+  // Starts the frame of a request in mRequestWriter, for the caller to add
+  // its fields; makeRequest() finishes and queues it, and returns the
+  // promise of its result.  The subject is the file or target the request
+  // is about.
+  JsonWriter& beginRequest(QLatin1String type);
+  QFutureInterfaceBase makeRequest(const QString& subject = QString(),
+                                   const QString& config = QString());
+  // Gives the result to the future of the request being answered.
+  template <typename T>
+  void reportReply(const T& result);
+  void recordRequest(const QByteArray& frame);
+  // Removes the next complete frame from mDataBuffer; returns its size on
+  // the wire, or 0 if there is none yet.  A bulk payload refers to the
+  // daemon's segment until releaseBulk().
+  qint64 takeFrame(QByteArray* payload, bool* bulk);
+  void decodePartialReply();
+  void clearDataBuffer();
+
+  // Replies shorter than this are decoded once complete.
+  static const int partialDecodeThreshold = 64 * 1024;
   void writeHandshake();
 
 private:
-  QProcess* mServerProcess;
+  DaemonTransport* spawnDaemon(const QString& cmakeExe,
+                               const QString& buildDir);
+  void attachDaemon(DaemonTransport* daemon);
+  void stopDaemon(DaemonTransport*& daemon);
+  void recoverDaemon();
+  void daemonGone();
+  // Whether the standby daemon has said it started, looking only at the
+  // frames it sent since the last call.
+  bool standbyProcessStarted();
+  void storeBuildsystem(const CMakeBuildsystem& buildsystem);
+  void hibernate();
+  void revive();
+  void replyFromCache(const QByteArray& frame, const QString& config);
+  static bool isCachedRequest(const QString& type);
+
+  struct PendingRequest
+  {
+    QString type;
+    QString subject;
+    QString config;
+    QString supersedeKey;
+    Priority priority = Interactive;
+    quint32 generation = 0;
+    qint64 queuedAt = 0;
+    qint64 sentAt = 0;
+    QByteArray frame;
+    QFutureInterfaceBase promise;
+  };
+
+  // The request the reply at the front of mDataBuffer answers; an
+  // unsolicited reply gets an empty one of the current generation.
+  PendingRequest headRequest() const;
+  void advanceGeneration();
+
+  void writeRequest(PendingRequest request);
+  void pumpRequests();
+  void clearRequests();
+  static void cancelRequest(PendingRequest& request);
+  bool supersedeQueued(const PendingRequest& request);
+
+  // Unwritten bytes in the pipe above which requests stay queued.
+  static const qint64 maxBytesToWrite = 1024 * 1024;
+
+  // How long a queued request waits before it overtakes other classes.
+  static const qint64 agingLimitNs = 500 * 1000 * 1000;
+
+  // Consecutive crashes tolerated before the client gives up.
+  static const int maxRestarts = 3;
+
+  DaemonTransport* mDaemon;
+  DaemonTransport* mStandbyDaemon;
+  QByteArray mStandbyBuffer;
+  // How far mStandbyBuffer has been looked through for process-started.
+  int mStandbyScanned = 0;
+  bool mStandbyHandshakeSent = false;
+  QString mStandbyCMakeExe;
+  QString mStandbyBuildDir;
+  bool mBulkChannel = false;
+  int mRestartCount = 0;
+  bool mRecovering = false;
+  // The build may have changed while no daemon watched it; the next live
+  // buildsystem reply is compared with the one before.
+  bool mVerifyBuildsystem = false;
+  bool mHandshakeSent = false;
+  bool mHibernating = false;
+  QTimer* mHibernateTimer;
+  quint32 mGeneration = 0;
+  ResultsStore* mResults;
+  // The request whose reply is being handled.  A reply from cache is
+  // handled as one of a request without a promise.
+  PendingRequest mReply;
+  ProtocolRecorder* mRecorder;
+  JsonWriter mRequestWriter;
+  QString mRequestType;
   QByteArray mDataBuffer;
+  WireFormat mWireFormat = JsonWire;
+  // Decodes the JSON reply at the front of mDataBuffer as it arrives.
+  ReplyDecoder* mReplyDecoder;
+  int mArrivedCount = 0;
   State mState;
+  QString mCMakeExe;
   QString mBuildDir;
   QString mSourceDir;
   QString mProjectName;
+
+  // Written and awaiting a reply, in the order written.
+  QQueue<PendingRequest> mPending;
+  QQueue<PendingRequest> mQueued[NumPriorities];
+  int mInFlight[NumPriorities] = {};
+  int mInFlightLimit[NumPriorities] = { 64, 2 };
+  bool mSupersede = true;
+  QElapsedTimer mClock;
+  RequestStats mStats;
 };
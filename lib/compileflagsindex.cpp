@@ -0,0 +1,186 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "compileflagsindex.h"
+
+#include "cmakeclient.h"
+#include "jsonwriter.h"
+
+#include <QIODevice>
+
+CompileFlagsIndex::CompileFlagsIndex(CMakeClient* client, QObject* parent)
+  : QObject(parent), mClient(client)
+{
+  connect(mClient, &CMakeClient::generationChanged,
+          this, &CompileFlagsIndex::clear);
+  connect(mClient, &CMakeClient::targetInfoRetrieved,
+          this, &CompileFlagsIndex::insert);
+}
+
+void CompileFlagsIndex::setConfig(const QString& config)
+{
+  mConfig = config;
+}
+
+void CompileFlagsIndex::clear()
+{
+  mFlagSets.clear();
+  mFlagSetIds.clear();
+  mConfigs.clear();
+}
+
+int CompileFlagsIndex::intern(const QStringList& incs, const QStringList& defs)
+{
+  auto key = incs.join(QLatin1Char('\n')) + QLatin1Char('\0')
+      + defs.join(QLatin1Char('\n'));
+  auto it = mFlagSetIds.constFind(key);
+  if (it != mFlagSetIds.constEnd())
+    {
+      return it.value();
+    }
+
+  FlagSet flags;
+  flags.IncludeDirectories = incs;
+  flags.CompileDefinitions = defs;
+  for (auto const& inc : incs)
+    {
+      flags.encodedArguments += ',';
+      JsonWriter::appendString(flags.encodedArguments,
+                               QLatin1String("-I") + inc);
+    }
+  for (auto const& def : defs)
+    {
+      flags.encodedArguments += ',';
+      JsonWriter::appendString(flags.encodedArguments,
+                               QLatin1String("-D") + def);
+    }
+  if (!flags.encodedArguments.isEmpty())
+    {
+      flags.encodedArguments.remove(0, 1);
+    }
+
+  auto id = mFlagSets.size();
+  mFlagSets.append(flags);
+  mFlagSetIds.insert(key, id);
+  return id;
+}
+
+void CompileFlagsIndex::insert(const CMakeTargetInfo& info)
+{
+  auto id = intern(info.IncludeDirectories, info.CompileDefinitions);
+  auto& index = mConfigs[info.Config];
+  index.targetFlags.insert(info.Name, id);
+  for (auto const& src : info.Sources)
+    {
+      index.sourceFlags.insert(src, id);
+    }
+  for (auto const& src : info.GeneratedSources)
+    {
+      index.sourceFlags.insert(src, id);
+    }
+}
+
+const CompileFlagsIndex::ConfigIndex& CompileFlagsIndex::current() const
+{
+  static const ConfigIndex empty;
+  auto it = mConfigs.constFind(mConfig);
+  return it == mConfigs.constEnd() ? empty : it.value();
+}
+
+const CompileFlagsIndex::FlagSet* CompileFlagsIndex::flagsForSource(
+    const QString& source) const
+{
+  auto const& sourceFlags = current().sourceFlags;
+  auto it = sourceFlags.constFind(source);
+  return it == sourceFlags.constEnd() ? nullptr : &mFlagSets.at(it.value());
+}
+
+const CompileFlagsIndex::FlagSet* CompileFlagsIndex::flagsForTarget(
+    const QString& targetName) const
+{
+  auto const& targetFlags = current().targetFlags;
+  auto it = targetFlags.constFind(targetName);
+  return it == targetFlags.constEnd() ? nullptr : &mFlagSets.at(it.value());
+}
+
+int CompileFlagsIndex::sourceCount() const
+{
+  return current().sourceFlags.size();
+}
+
+int CompileFlagsIndex::flagSetCount() const
+{
+  return mFlagSets.size();
+}
+
+bool CompileFlagsIndex::writeCompileCommands(QIODevice* device,
+                                             const QString& cxxCompiler,
+                                             const QString& cCompiler) const
+{
+  auto const& sourceFlags = current().sourceFlags;
+
+  QByteArray prefix = "{\"directory\":";
+  JsonWriter::appendString(prefix, mClient->buildDir());
+  prefix += ",\"file\":";
+
+  QByteArray encodedCxxCompiler;
+  JsonWriter::appendString(encodedCxxCompiler, cxxCompiler);
+  QByteArray encodedCCompiler;
+  JsonWriter::appendString(encodedCCompiler, cCompiler);
+
+  QByteArray entry;
+  QByteArray encodedSource;
+  bool first = true;
+  if (device->write("[\n", 2) != 2)
+    {
+      return false;
+    }
+  for (auto it = sourceFlags.constBegin(); it != sourceFlags.constEnd(); ++it)
+    {
+      encodedSource.clear();
+      JsonWriter::appendString(encodedSource, it.key());
+      auto const& flags = mFlagSets.at(it.value());
+
+      entry.clear();
+      if (!first)
+        {
+          entry += ",\n";
+        }
+      first = false;
+      entry += prefix;
+      entry += encodedSource;
+      entry += ",\"arguments\":[";
+      // ".C" is C++, so the suffix is compared case-sensitively.
+      entry += it.key().endsWith(QLatin1String(".c"))
+          ? encodedCCompiler : encodedCxxCompiler;
+      if (!flags.encodedArguments.isEmpty())
+        {
+          entry += ',';
+          entry += flags.encodedArguments;
+        }
+      entry += ",\"-c\",";
+      entry += encodedSource;
+      entry += "]}";
+      if (device->write(entry) != entry.size())
+        {
+          return false;
+        }
+    }
+  return device->write("\n]\n", 3) == 3;
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class CMakeClient;
+class QIODevice;
+struct CMakeTargetInfo;
+
+// The include directories and defines every source is compiled with, as
+// reported by target_info for each configuration.  Targets with the same
+// flags share one interned flag set, which also carries its arguments
+// already encoded for compile_commands.json.  Lookups are answered for the
+// current configuration.
+class CompileFlagsIndex : public QObject
+{
+  Q_OBJECT
+public:
+  struct FlagSet
+  {
+    QStringList IncludeDirectories;
+    QStringList CompileDefinitions;
+    // The JSON array elements for the flags, without brackets.
+    QByteArray encodedArguments;
+  };
+
+  CompileFlagsIndex(CMakeClient* client, QObject* parent = 0);
+
+  void setConfig(const QString& config);
+
+  void insert(const CMakeTargetInfo& info);
+  void clear();
+
+  // Null when the source or target is not known.
+  const FlagSet* flagsForSource(const QString& source) const;
+  const FlagSet* flagsForTarget(const QString& targetName) const;
+
+  int sourceCount() const;
+  int flagSetCount() const;
+
+  // Writes one entry per source, a few hundred bytes at a time.  Sources
+  // ending in ".c" are given cCompiler and all others cxxCompiler; the
+  // real compiler of each target is not reported by target_info.
+  bool writeCompileCommands(QIODevice* device,
+                            const QString& cxxCompiler = QStringLiteral("c++"),
+                            const QString& cCompiler = QStringLiteral("cc")) const;
+
+private:
+  struct ConfigIndex
+  {
+    QHash<QString, int> targetFlags;
+    QHash<QString, int> sourceFlags;
+  };
+
+  int intern(const QStringList& incs, const QStringList& defs);
+  const ConfigIndex& current() const;
+
+private:
+  CMakeClient* mClient;
+  QString mConfig;
+  QVector<FlagSet> mFlagSets;
+  QHash<QString, int> mFlagSetIds;
+  QHash<QString, ConfigIndex> mConfigs;
+};
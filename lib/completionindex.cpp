@@ -0,0 +1,144 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "completionindex.h"
+
+#include "cmakeclient.h"
+
+#include <algorithm>
+
+namespace {
+
+// Commands are case-insensitive, and typing "add_" should offer
+// "ADD_CUSTOM_COMMAND" as well, so names are ordered ignoring case.
+bool lessIgnoringCase(const QString& lhs, const QString& rhs)
+{
+  int cmp = lhs.compare(rhs, Qt::CaseInsensitive);
+  return cmp != 0 ? cmp < 0 : lhs < rhs;
+}
+
+bool lessThanPrefix(const QString& name, const QString& prefix)
+{
+  return name.compare(prefix, Qt::CaseInsensitive) < 0;
+}
+
+}
+
+CompletionIndex::CompletionIndex(CMakeClient* client, QObject* parent)
+  : QObject(parent)
+{
+  connect(client, &CMakeClient::generationChanged,
+          this, &CompletionIndex::clear);
+
+  connect(client, &CMakeClient::targetsRetrieved, this,
+          [this](QStringList const&, QVector<CMakeTarget> const& targets) {
+      QStringList names;
+      names.reserve(targets.size());
+      for (auto const& tgt : targets)
+        {
+          names.push_back(tgt.Name);
+        }
+      replace(Targets, names);
+    });
+
+  connect(client, &CMakeClient::completionsRetrieved, this,
+          [this](const QString& matcher, const QStringList& results,
+                 const QStringList&, const QString& kind) {
+      // The variables of a reply are those in scope at one line of one
+      // file, which says nothing of any other position.
+      Kind k;
+      if (kind == QLatin1String("commands"))
+        k = Commands;
+      else if (kind == QLatin1String("targets"))
+        k = Targets;
+      else
+        return;
+
+      for (auto const& result : results)
+        {
+          insert(k, result);
+        }
+      // An unfiltered reply lists every candidate of its kind.
+      if (matcher.isEmpty())
+        {
+          mBuckets[k].complete = true;
+        }
+    });
+}
+
+bool CompletionIndex::isComplete(Kind kind) const
+{
+  return mBuckets[kind].complete;
+}
+
+void CompletionIndex::merge(Bucket& bucket) const
+{
+  if (bucket.pending.isEmpty())
+    {
+      return;
+    }
+  for (auto const& name : bucket.sorted)
+    {
+      bucket.pending.insert(name);
+    }
+  bucket.sorted = bucket.pending.toList();
+  bucket.pending.clear();
+  std::sort(bucket.sorted.begin(), bucket.sorted.end(), lessIgnoringCase);
+}
+
+QStringList CompletionIndex::complete(Kind kind, const QString& prefix) const
+{
+  auto& bucket = mBuckets[kind];
+  merge(bucket);
+
+  QStringList result;
+  auto it = std::lower_bound(bucket.sorted.constBegin(),
+                             bucket.sorted.constEnd(), prefix, lessThanPrefix);
+  for ( ; it != bucket.sorted.constEnd()
+          && it->startsWith(prefix, Qt::CaseInsensitive); ++it)
+    {
+      result.push_back(*it);
+    }
+  return result;
+}
+
+void CompletionIndex::insert(Kind kind, const QString& name)
+{
+  if (!name.isEmpty())
+    {
+      mBuckets[kind].pending.insert(name);
+    }
+}
+
+void CompletionIndex::replace(Kind kind, const QStringList& names)
+{
+  auto& bucket = mBuckets[kind];
+  bucket.sorted.clear();
+  bucket.pending = names.toSet();
+  bucket.pending.remove(QString());
+  bucket.complete = true;
+}
+
+void CompletionIndex::clear()
+{
+  for (auto& bucket : mBuckets)
+    {
+      bucket = Bucket();
+    }
+}
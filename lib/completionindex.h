@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+class CMakeClient;
+
+// Prefix index over the completion candidates the client already knows
+// about, so that the common kinds can be answered without sending the
+// whole document to the daemon.  Variables depend on the position in the
+// project, so the index is complete for them only once given them with
+// replace().
+class CompletionIndex : public QObject
+{
+  Q_OBJECT
+public:
+  enum Kind {
+    Variables,
+    Commands,
+    Targets,
+    NumKinds
+  };
+
+  CompletionIndex(CMakeClient* client, QObject* parent = 0);
+
+  // Whether the candidates of the kind can be answered locally.
+  bool isComplete(Kind kind) const;
+
+  // The names starting with prefix, ignoring case.
+  QStringList complete(Kind kind, const QString& prefix) const;
+
+  void insert(Kind kind, const QString& name);
+  void replace(Kind kind, const QStringList& names);
+  void clear();
+
+private:
+  struct Bucket
+  {
+    // Names are collected unsorted and merged into the sorted list on the
+    // next lookup, so that large snapshots are sorted once.
+    QStringList sorted;
+    QSet<QString> pending;
+    bool complete = false;
+  };
+
+  void merge(Bucket& bucket) const;
+
+private:
+  mutable Bucket mBuckets[NumKinds];
+};
@@ -0,0 +1,235 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "completionmodel.h"
+
+#include "cmakeclient.h"
+#include "futures.h"
+
+#include <ktexteditor/document.h>
+#include <ktexteditor/view.h>
+
+#include <QFileInfo>
+#include <QRegularExpression>
+
+namespace {
+
+// Commands whose arguments name targets.
+const char* const targetCommands[] = {
+  "add_dependencies",
+  "get_target_property",
+  "set_target_properties",
+  "target_compile_definitions",
+  "target_compile_options",
+  "target_include_directories",
+  "target_link_libraries",
+  "target_sources"
+};
+
+bool takesTargets(const QString& command)
+{
+  for (auto name : targetCommands)
+    {
+      if (command.compare(QLatin1String(name), Qt::CaseInsensitive) == 0)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+}
+
+CompletionModel::CompletionModel(CMakeClient* client, CompletionIndex* index,
+                                 QObject* parent)
+  : KTextEditor::CodeCompletionModel(parent), mClient(client), mIndex(index)
+{
+}
+
+bool CompletionModel::isCMakeDocument(KTextEditor::Document* doc)
+{
+  auto fileName = QFileInfo(doc->url().toLocalFile()).fileName();
+  return fileName == QLatin1String("CMakeLists.txt")
+      || fileName.endsWith(QLatin1String(".cmake"));
+}
+
+void CompletionModel::completionInvoked(KTextEditor::View* view,
+                                        const KTextEditor::Range& range,
+                                        InvocationType invocationType)
+{
+  Q_UNUSED(invocationType)
+
+  auto doc = view->document();
+  if (!isCMakeDocument(doc) || mClient->GetState() != CMakeClient::Idle)
+    {
+      return;
+    }
+
+  auto prefix = doc->text(range);
+  // A request to a restarted daemon is cancelled, so is not waited for.
+  bool waiting = !mAwaited.isFinished();
+
+  CompletionIndex::Kind kind;
+  if (localKind(doc, range.start(), &kind))
+    {
+      // Answered from the index; a reply still in flight is stale now.
+      mView = view;
+      mAwaited.cancel();
+      mAwaited = QFuture<CMakeCompletions>();
+      mResults = mIndex->complete(kind, prefix);
+      mDescriptions.clear();
+      mMatcher = prefix;
+      mResultsStart = range.start();
+      filterLocally(prefix);
+      return;
+    }
+
+  if (view == mView && !waiting && !mResults.isEmpty()
+      && range.start() == mResultsStart
+      && prefix.startsWith(mMatcher, Qt::CaseInsensitive))
+    {
+      filterLocally(prefix);
+      return;
+    }
+
+  if (view == mView && waiting && range.start() == mPendingStart)
+    {
+      // The reply in flight covers this word too; it is filtered against
+      // whatever has been typed by the time it arrives.
+      return;
+    }
+
+  mView = view;
+  mPendingStart = range.start();
+  mResults.clear();
+  mDescriptions.clear();
+  mMatcher.clear();
+  filterLocally(QString());
+
+  mAwaited.cancel();
+  mAwaited = mClient->retrieveCompletions(range.end().line() + 1,
+                                          range.end().column(),
+                                          doc->url().toLocalFile(),
+                                          doc->text());
+  onFinished(mAwaited, this, [this](const QFuture<CMakeCompletions>& done) {
+      if (done != mAwaited || done.isCanceled() || done.resultCount() == 0)
+        {
+          return;
+        }
+      mAwaited = QFuture<CMakeCompletions>();
+      setCompletions(done.result());
+    });
+}
+
+void CompletionModel::setCompletions(const CMakeCompletions& completions)
+{
+  if (!mView)
+    {
+      return;
+    }
+
+  mResults = completions.Results;
+  mDescriptions = completions.Descriptions;
+  mMatcher = completions.Matcher;
+  mResultsStart = mPendingStart;
+
+  QString prefix;
+  auto cursor = mView->cursorPosition();
+  if (cursor.line() == mResultsStart.line() && cursor >= mResultsStart)
+    {
+      prefix = mView->document()->text({mResultsStart, cursor});
+    }
+  filterLocally(prefix);
+}
+
+bool CompletionModel::localKind(KTextEditor::Document* doc,
+                                const KTextEditor::Cursor& start,
+                                CompletionIndex::Kind* kind) const
+{
+  auto before = doc->line(start.line()).left(start.column());
+
+  if (before.endsWith(QLatin1String("${")))
+    {
+      *kind = CompletionIndex::Variables;
+    }
+  else if (before.trimmed().isEmpty())
+    {
+      *kind = CompletionIndex::Commands;
+    }
+  else
+    {
+      static const QRegularExpression callStart(
+            QStringLiteral("^\\s*(\\w+)\\s*\\("));
+      auto match = callStart.match(before);
+      if (!match.hasMatch() || !takesTargets(match.captured(1)))
+        {
+          return false;
+        }
+      *kind = CompletionIndex::Targets;
+    }
+  return mIndex->isComplete(*kind);
+}
+
+void CompletionModel::filterLocally(const QString& prefix)
+{
+  beginResetModel();
+  mVisible.clear();
+  for (int i = 0; i < mResults.size(); ++i)
+    {
+      if (mResults.at(i).startsWith(prefix, Qt::CaseInsensitive))
+        {
+          mVisible.push_back(i);
+        }
+    }
+  setRowCount(mVisible.size());
+  endResetModel();
+}
+
+QVariant CompletionModel::data(const QModelIndex& index, int role) const
+{
+  if (!index.isValid() || index.row() >= mVisible.size()
+      || role != Qt::DisplayRole)
+    {
+      return QVariant();
+    }
+
+  auto result = mVisible.at(index.row());
+  if (index.column() == Name)
+    {
+      return mResults.at(result);
+    }
+  if (index.column() == Postfix && result < mDescriptions.size())
+    {
+      return mDescriptions.at(result);
+    }
+  return QVariant();
+}
+
+bool CompletionModel::shouldStartCompletion(KTextEditor::View* view,
+                                            const QString& insertedText,
+                                            bool userInsertion,
+                                            const KTextEditor::Cursor& position)
+{
+  if (userInsertion && insertedText.endsWith(QLatin1String("${")))
+    {
+      return true;
+    }
+  return KTextEditor::CodeCompletionModelControllerInterface::shouldStartCompletion(
+        view, insertedText, userInsertion, position);
+}
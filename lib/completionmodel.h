@@ -0,0 +1,78 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QFuture>
+#include <QPointer>
+#include <QStringList>
+#include <QVector>
+
+#include <ktexteditor/codecompletionmodel.h>
+#include <ktexteditor/codecompletionmodelcontrollerinterface.h>
+
+#include "cmakeclient.h"
+#include "completionindex.h"
+
+class CompletionModel : public KTextEditor::CodeCompletionModel,
+                        public KTextEditor::CodeCompletionModelControllerInterface
+{
+  Q_OBJECT
+  Q_INTERFACES(KTextEditor::CodeCompletionModelControllerInterface)
+public:
+  CompletionModel(CMakeClient* client, CompletionIndex* index,
+                  QObject* parent = 0);
+
+  void completionInvoked(KTextEditor::View* view,
+                         const KTextEditor::Range& range,
+                         InvocationType invocationType) override;
+
+  QVariant data(const QModelIndex& index, int role) const override;
+
+  bool shouldStartCompletion(KTextEditor::View* view,
+                             const QString& insertedText,
+                             bool userInsertion,
+                             const KTextEditor::Cursor& position) override;
+
+  static bool isCMakeDocument(KTextEditor::Document* doc);
+
+private:
+  void setCompletions(const CMakeCompletions& completions);
+  void filterLocally(const QString& prefix);
+  bool localKind(KTextEditor::Document* doc, const KTextEditor::Cursor& start,
+                 CompletionIndex::Kind* kind) const;
+
+private:
+  CMakeClient* mClient;
+  CompletionIndex* mIndex;
+  QPointer<KTextEditor::View> mView;
+
+  // The last result set from the daemon, and the position it was
+  // requested for.  While the user keeps typing the same word it is
+  // narrowed here rather than asked for again.
+  QStringList mResults;
+  QStringList mDescriptions;
+  QString mMatcher;
+  KTextEditor::Cursor mResultsStart;
+  KTextEditor::Cursor mPendingStart;
+  QVector<int> mVisible;
+
+  // The request whose reply is waited for; any other is stale.
+  QFuture<CMakeCompletions> mAwaited;
+};
@@ -0,0 +1,159 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "daemontransport.h"
+#include "utility.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QProcess>
+#include <QTimer>
+
+#include <cstring>
+
+DaemonTransport::DaemonTransport(QObject* parent)
+  : QObject(parent)
+{
+}
+
+bool DaemonTransport::hasBulkChannel() const
+{
+  return false;
+}
+
+QByteArray DaemonTransport::bulkPayload(quint32 size)
+{
+  Q_UNUSED(size)
+  return QByteArray();
+}
+
+void DaemonTransport::releaseBulk()
+{
+}
+
+PipeTransport::PipeTransport(QObject* parent)
+  : DaemonTransport(parent), mProcess(new QProcess(this))
+{
+  connect(mProcess, &QProcess::readyReadStandardOutput,
+          this, &DaemonTransport::readyRead);
+  connect(mProcess, &QProcess::bytesWritten,
+          this, &DaemonTransport::bytesWritten);
+  connect(mProcess,
+          SELECT<QProcess::ProcessError>::OVERLOAD_OF(&QProcess::error),
+          this, [this](QProcess::ProcessError error) {
+      qDebug() << "SERVER ERROR" << error;
+      if (error == QProcess::FailedToStart)
+        {
+          QTimer::singleShot(0, this, [this] {
+              Q_EMIT failedToStart();
+            });
+        }
+    });
+  connect(mProcess,
+          SELECT<int, QProcess::ExitStatus>::OVERLOAD_OF(&QProcess::finished),
+          this, [this](int exitCode, QProcess::ExitStatus status) {
+      Q_EMIT finished(exitCode, status == QProcess::CrashExit);
+    });
+}
+
+PipeTransport::~PipeTransport()
+{
+  // Killing the daemon must not reach a half destroyed transport.
+  disconnect(mProcess, nullptr, this, nullptr);
+  delete mProcess;
+}
+
+void PipeTransport::start(const QString& cmakeExe, const QString& buildDir)
+{
+  mProcess->setWorkingDirectory(buildDir);
+  mProcess->start(cmakeExe + " -E daemon " + buildDir, QProcess::ReadWrite);
+}
+
+void PipeTransport::write(const QByteArray& data)
+{
+  mProcess->write(data);
+}
+
+qint64 PipeTransport::bytesToWrite() const
+{
+  return mProcess->bytesToWrite();
+}
+
+QByteArray PipeTransport::readAll()
+{
+  return mProcess->readAll();
+}
+
+SharedMemoryTransport::SharedMemoryTransport(int capacity, QObject* parent)
+  : PipeTransport(parent), mCapacity(capacity)
+{
+}
+
+void SharedMemoryTransport::start(const QString& cmakeExe,
+                                  const QString& buildDir)
+{
+  static int segmentCount = 0;
+  mSegment.setKey(QStringLiteral("cmakekate-%1-%2")
+                  .arg(QCoreApplication::applicationPid())
+                  .arg(++segmentCount));
+  if (mSegment.create(dataOffset + mCapacity))
+    {
+      mSegment.lock();
+      memset(mSegment.data(), 0, dataOffset);
+      mSegment.unlock();
+      auto env = QProcessEnvironment::systemEnvironment();
+      env.insert(QStringLiteral("CMAKEKATE_BULK_KEY"), mSegment.key());
+      mProcess->setProcessEnvironment(env);
+    }
+  else
+    {
+      // The pipe alone still works.
+      qDebug() << "NO BULK CHANNEL" << mSegment.errorString();
+    }
+  PipeTransport::start(cmakeExe, buildDir);
+}
+
+bool SharedMemoryTransport::hasBulkChannel() const
+{
+  return mSegment.isAttached();
+}
+
+QByteArray SharedMemoryTransport::bulkPayload(quint32 size)
+{
+  if (!mSegment.isAttached()
+      || size > quint32(mSegment.size() - dataOffset))
+    {
+      return QByteArray();
+    }
+  // The daemon set the flag before sending the frame, and leaves the
+  // payload alone until it is cleared.
+  return QByteArray::fromRawData(
+        static_cast<const char*>(mSegment.constData()) + dataOffset, size);
+}
+
+void SharedMemoryTransport::releaseBulk()
+{
+  if (!mSegment.isAttached())
+    {
+      return;
+    }
+  mSegment.lock();
+  *static_cast<quint32*>(mSegment.data()) = 0;
+  mSegment.unlock();
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QObject>
+#include <QSharedMemory>
+
+class QProcess;
+
+// Carries frames between the client and a "cmake -E daemon" process.
+//
+// Replies may come in bulk frames, which hold only the size of a payload
+// that is handed over some other way; bulkPayload() gives access to it
+// until releaseBulk().  A transport without such a channel never receives
+// bulk frames.
+class DaemonTransport : public QObject
+{
+  Q_OBJECT
+public:
+  explicit DaemonTransport(QObject* parent = nullptr);
+
+  virtual void start(const QString& cmakeExe, const QString& buildDir) = 0;
+
+  virtual void write(const QByteArray& data) = 0;
+  virtual qint64 bytesToWrite() const = 0;
+  // Everything received since the last call.
+  virtual QByteArray readAll() = 0;
+
+  virtual bool hasBulkChannel() const;
+  virtual QByteArray bulkPayload(quint32 size);
+  virtual void releaseBulk();
+
+Q_SIGNALS:
+  void readyRead();
+  void bytesWritten();
+  // The daemon exited; a clean exit has exitCode 0 and crashed false.
+  void finished(int exitCode, bool crashed);
+  // The daemon could not be run at all, so never finishes.  Emitted from
+  // the event loop, so is seen even if start() fails at once.
+  void failedToStart();
+};
+
+// Everything over the daemon's stdin and stdout.
+class PipeTransport : public DaemonTransport
+{
+  Q_OBJECT
+public:
+  explicit PipeTransport(QObject* parent = nullptr);
+  ~PipeTransport();
+
+  void start(const QString& cmakeExe, const QString& buildDir) override;
+
+  void write(const QByteArray& data) override;
+  qint64 bytesToWrite() const override;
+  QByteArray readAll() override;
+
+protected:
+  QProcess* mProcess;
+};
+
+// Frames over the pipe as above, but a daemon may instead place a large
+// reply in a shared memory segment and send a bulk frame, so the reply is
+// decoded where it lies rather than copied through the pipe.
+//
+// The segment's key is passed to the daemon in CMAKEKATE_BULK_KEY.  It
+// starts with a quint32 flag which is set, under the segment's lock, while
+// it holds a payload not yet released; the payload follows at dataOffset.
+// A daemon which finds the flag set sends the reply over the pipe.
+class SharedMemoryTransport : public PipeTransport
+{
+  Q_OBJECT
+public:
+  explicit SharedMemoryTransport(int capacity = 64 * 1024 * 1024,
+                                 QObject* parent = nullptr);
+
+  void start(const QString& cmakeExe, const QString& buildDir) override;
+
+  bool hasBulkChannel() const override;
+  QByteArray bulkPayload(quint32 size) override;
+  void releaseBulk() override;
+
+  static const int dataOffset = 16;
+
+private:
+  int mCapacity;
+  QSharedMemory mSegment;
+};
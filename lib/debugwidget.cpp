@@ -45,7 +45,8 @@ DebugWidget::DebugWidget(CMakeClient* client, QWidget* parent)
   mPosLine = 1;
   mAnchorLine = 1;
 
-  layout->addWidget(new QLabel("Definitions"));
+  mTitle = new QLabel("Definitions");
+  layout->addWidget(mTitle);
 
   m_filterLineEdit = new QLineEdit;
   layout->addWidget(m_filterLineEdit);
@@ -79,8 +80,20 @@ QString format(QString const& input)
   return input.split(";").join("\n");
 }
 
+void DebugWidget::setTarget(const QString& name, const QStringList& includes,
+                            const QStringList& defines)
+{
+  QMap<QString, QString> defs;
+  defs["COMPILE_DEFINITIONS"] = defines.join(";");
+  defs["INCLUDE_DIRECTORIES"] = includes.join(";");
+  setContent(defs);
+
+  mTitle->setText("Target " + name);
+}
+
 void DebugWidget::setContent(QMap<QString, QString> const& defs)
 {
+  mTitle->setText("Definitions");
   m_defsModel->clear();
 
   for(auto key : defs.keys())
@@ -99,6 +112,7 @@ void DebugWidget::setContent(QMap<QString, QString> const& defs)
 void DebugWidget::setDiffContent(QMap<QString, QString> const& newDefs,
                               QMap<QString, QString> const& oldDefs)
 {
+  mTitle->setText("Definitions");
   m_defsModel->clear();
 
   for(auto key : newDefs.keys())
@@ -30,6 +30,7 @@ class QPushButton;
 class CMakeClient;
 class QStandardItemModel;
 class QTreeView;
+class QLabel;
 class QLineEdit;
 class QSortFilterProxyModel;
 
@@ -41,6 +42,11 @@ public:
 
   void setView(KTextEditor::View* ktev);
 
+  // Shows what the target compiles its sources with, for documents which
+  // are sources rather than CMake code.
+  void setTarget(const QString& name, const QStringList& includes,
+                 const QStringList& defines);
+
 private Q_SLOTS:
   void getDebugInfo();
 
@@ -56,6 +62,7 @@ Q_SIGNALS:
 
 private:
   KTextEditor::View* mKtev;
+  QLabel* mTitle;
   QStandardItemModel* m_defsModel;
   QTreeView* m_defsView;
   QLineEdit *m_filterLineEdit;
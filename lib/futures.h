@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QVector>
+
+// Calls f with the future once it has finished, or been cancelled, unless
+// context is destroyed first.  The call is always made from the event loop,
+// even for a future which is already finished.
+template <typename T, typename F>
+void onFinished(const QFuture<T>& future, QObject* context, F f)
+{
+  auto watcher = new QFutureWatcher<T>(context);
+  QObject::connect(watcher, &QFutureWatcherBase::finished, context,
+                   [watcher, f]() mutable {
+      f(watcher->future());
+      watcher->deleteLater();
+    });
+  watcher->setFuture(future);
+}
+
+// A future which finishes once all of the futures have.  Its results are
+// those of the futures which produced one, in the order given.  Cancelling
+// it cancels each of them.
+template <typename T>
+QFuture<T> whenAll(const QVector<QFuture<T> >& futures, QObject* context)
+{
+  QFutureInterface<T> all;
+  all.reportStarted();
+  if (futures.isEmpty())
+    {
+      all.reportFinished();
+      return all.future();
+    }
+
+  auto remaining = QSharedPointer<int>::create(futures.size());
+  for (int i = 0; i < futures.size(); ++i)
+    {
+      onFinished(futures.at(i), context,
+                 [all, remaining, i](const QFuture<T>& future) mutable {
+          if (!future.isCanceled() && future.resultCount() > 0)
+            {
+              all.reportResult(future.result(), i);
+            }
+          if (--*remaining == 0)
+            {
+              all.reportFinished();
+            }
+        });
+    }
+
+  auto watcher = new QFutureWatcher<T>(context);
+  QObject::connect(watcher, &QFutureWatcherBase::canceled, context,
+                   [futures]() mutable {
+      for (auto& future : futures)
+        {
+          future.cancel();
+        }
+    });
+  QObject::connect(watcher, &QFutureWatcherBase::finished,
+                   watcher, &QObject::deleteLater);
+  watcher->setFuture(all.future());
+  return all.future();
+}
@@ -0,0 +1,268 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "helpprovider.h"
+
+#include "cmakeclient.h"
+#include "completionmodel.h"
+#include "futures.h"
+
+#include <ktexteditor/document.h>
+#include <ktexteditor/movinginterface.h>
+#include <ktexteditor/view.h>
+
+#include <QProcess>
+#include <QTimer>
+
+namespace {
+
+bool isWordChar(QChar c)
+{
+  return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+QString pageKey(const QString& context, const QString& helpKey)
+{
+  return context + QLatin1Char('/') + helpKey;
+}
+
+}
+
+HelpProvider::HelpProvider(CMakeClient* client, QObject* parent)
+  : QObject(parent), mClient(client)
+{
+  mIdleTimer = new QTimer(this);
+  mIdleTimer->setSingleShot(true);
+  mIdleTimer->setInterval(300);
+  connect(mIdleTimer, &QTimer::timeout, this, &HelpProvider::prefetch);
+}
+
+void HelpProvider::setView(KTextEditor::View* view)
+{
+  if (mView)
+    {
+      disconnect(mView, nullptr, this, nullptr);
+    }
+  mView = view;
+  if (!mView)
+    {
+      return;
+    }
+  connect(mView, &KTextEditor::View::cursorPositionChanged, this, [this] {
+      mIdleTimer->start();
+    });
+  mIdleTimer->start();
+}
+
+HelpProvider::DocumentCache& HelpProvider::cacheFor(KTextEditor::Document* doc)
+{
+  auto moving = qobject_cast<KTextEditor::MovingInterface*>(doc);
+  qint64 revision = moving ? moving->revision() : 0;
+
+  if (!mDocuments.contains(doc))
+    {
+      connect(doc, &QObject::destroyed, this, [this, doc] {
+          mDocuments.remove(doc);
+        });
+    }
+
+  auto& cache = mDocuments[doc];
+  if (cache.revision != revision)
+    {
+      cache.revision = revision;
+      cache.entries.clear();
+      cache.requested.clear();
+    }
+  return cache;
+}
+
+void HelpProvider::requestHelp(KTextEditor::Document* doc,
+                               const KTextEditor::Range& token)
+{
+  if (!token.isValid() || token.isEmpty())
+    {
+      return;
+    }
+
+  auto& cache = cacheFor(doc);
+  QPair<int, int> span(token.start().line(), token.start().column());
+  if (cache.entries.contains(span) || cache.requested.contains(span))
+    {
+      return;
+    }
+  cache.requested.insert(span);
+
+  PendingHelp pending;
+  pending.doc = doc;
+  pending.revision = cache.revision;
+  pending.span = span;
+
+  auto future = mClient->retrieveContextualHelp(doc->url().toLocalFile(),
+                                                token.start().line() + 1,
+                                                token.start().column(),
+                                                doc->text());
+  onFinished(future, this,
+             [this, pending](const QFuture<CMakeContextualHelp>& done) {
+      helpRetrieved(pending, done);
+    });
+}
+
+void HelpProvider::prefetch()
+{
+  if (!mView || mClient->GetState() != CMakeClient::Idle)
+    {
+      return;
+    }
+  auto doc = mView->document();
+  if (!CompletionModel::isCMakeDocument(doc))
+    {
+      return;
+    }
+
+  auto cursor = mView->cursorPosition();
+  auto token = doc->wordRangeAt(cursor);
+  requestHelp(doc, token);
+
+  // The tokens on either side are the next likely hover targets.
+  auto line = doc->line(cursor.line());
+  int col = (token.isValid() ? token.start().column() : cursor.column()) - 1;
+  // The cursor may be past the end of the line.
+  col = qMin(col, line.size() - 1);
+  while (col >= 0 && !isWordChar(line.at(col)))
+    {
+      --col;
+    }
+  if (col >= 0)
+    {
+      requestHelp(doc, doc->wordRangeAt({cursor.line(), col}));
+    }
+
+  col = token.isValid() ? token.end().column() : cursor.column();
+  while (col < line.size() && !isWordChar(line.at(col)))
+    {
+      ++col;
+    }
+  if (col < line.size())
+    {
+      requestHelp(doc, doc->wordRangeAt({cursor.line(), col}));
+    }
+}
+
+void HelpProvider::helpRetrieved(const PendingHelp& pending,
+                                 const QFuture<CMakeContextualHelp>& done)
+{
+  if (!pending.doc)
+    {
+      return;
+    }
+
+  auto& cache = cacheFor(pending.doc);
+  if (cache.revision != pending.revision)
+    {
+      return;
+    }
+  if (done.isCanceled() || done.resultCount() == 0)
+    {
+      // A request to a restarted daemon is cancelled; ask again later.
+      cache.requested.remove(pending.span);
+      return;
+    }
+
+  auto help = done.result();
+  HelpEntry entry;
+  entry.context = help.Context;
+  entry.helpKey = help.Key;
+  cache.entries.insert(pending.span, entry);
+
+  if (!entry.context.isEmpty())
+    {
+      renderPage(entry);
+    }
+}
+
+void HelpProvider::renderPage(const HelpEntry& entry)
+{
+  auto key = pageKey(entry.context, entry.helpKey);
+  if (mPages.contains(key) || mClient->cmakeExecutable().isEmpty())
+    {
+      return;
+    }
+  mPages.insert(key, QString());
+
+  auto proc = new QProcess(this);
+  connect(proc, SELECT<int>::OVERLOAD_OF(&QProcess::finished),
+          this, [this, proc, key] {
+      auto lines = QString::fromLocal8Bit(proc->readAllStandardOutput())
+          .split(QLatin1Char('\n'));
+      mPages[key] = lines.mid(0, 40).join(QLatin1Char('\n')).trimmed();
+      proc->deleteLater();
+    });
+  connect(proc,
+          SELECT<QProcess::ProcessError>::OVERLOAD_OF(&QProcess::error),
+          this, [this, proc, key](QProcess::ProcessError error) {
+      if (error == QProcess::FailedToStart)
+        {
+          mPages.remove(key);
+          proc->deleteLater();
+        }
+    });
+  proc->start(mClient->cmakeExecutable(),
+              QStringList() << QString(QLatin1String("--help-") + entry.context)
+                            << entry.helpKey);
+}
+
+QString HelpProvider::textHint(KTextEditor::View* view,
+                               const KTextEditor::Cursor& position)
+{
+  auto doc = view->document();
+  if (!CompletionModel::isCMakeDocument(doc))
+    {
+      return QString();
+    }
+
+  auto token = doc->wordRangeAt(position);
+  if (!token.isValid() || token.isEmpty())
+    {
+      return QString();
+    }
+
+  auto& cache = cacheFor(doc);
+  auto it = cache.entries.constFind(
+        qMakePair(token.start().line(), token.start().column()));
+  if (it == cache.entries.constEnd())
+    {
+      if (mClient->GetState() == CMakeClient::Idle)
+        {
+          requestHelp(doc, token);
+        }
+      return QString();
+    }
+  if (it->context.isEmpty())
+    {
+      return QString();
+    }
+
+  auto page = mPages.value(pageKey(it->context, it->helpKey));
+  if (page.isEmpty())
+    {
+      renderPage(*it);
+      return it->context + QLatin1String(": ") + it->helpKey;
+    }
+  return page;
+}
@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QFuture>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QSet>
+
+#include <ktexteditor/range.h>
+#include <ktexteditor/texthintinterface.h>
+
+class CMakeClient;
+class QTimer;
+struct CMakeContextualHelp;
+
+namespace KTextEditor
+{
+  class Document;
+  class View;
+}
+
+// Serves contextual help as hover tooltips.  The daemon answers are cached
+// per document revision and token, and the help pages per help key.  Help
+// for the tokens around the cursor is requested while the editor is idle,
+// so that a hover is normally answered from the cache.
+class HelpProvider : public QObject, public KTextEditor::TextHintProvider
+{
+  Q_OBJECT
+public:
+  HelpProvider(CMakeClient* client, QObject* parent = 0);
+
+  void setView(KTextEditor::View* view);
+
+  QString textHint(KTextEditor::View* view,
+                   const KTextEditor::Cursor& position) override;
+
+private:
+  struct HelpEntry
+  {
+    QString context;
+    QString helpKey;
+  };
+
+  struct PendingHelp
+  {
+    QPointer<KTextEditor::Document> doc;
+    qint64 revision;
+    QPair<int, int> span;
+  };
+
+  struct DocumentCache
+  {
+    qint64 revision = -1;
+    QHash<QPair<int, int>, HelpEntry> entries;
+    QSet<QPair<int, int> > requested;
+  };
+
+  DocumentCache& cacheFor(KTextEditor::Document* doc);
+  void requestHelp(KTextEditor::Document* doc, const KTextEditor::Range& token);
+  void prefetch();
+  void helpRetrieved(const PendingHelp& pending,
+                     const QFuture<CMakeContextualHelp>& done);
+  void renderPage(const HelpEntry& entry);
+
+private:
+  CMakeClient* mClient;
+  QPointer<KTextEditor::View> mView;
+  QTimer* mIdleTimer;
+
+  QHash<KTextEditor::Document*, DocumentCache> mDocuments;
+
+  // Rendered help pages by "context/key"; an empty value marks a page
+  // which is being rendered.
+  QHash<QString, QString> mPages;
+};
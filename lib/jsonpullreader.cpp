@@ -0,0 +1,286 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "jsonpullreader.h"
+
+#include <QByteArray>
+
+#include <cstring>
+
+void JsonPullReader::setData(const char* data, int size)
+{
+  mData = data;
+  mSize = size;
+}
+
+int JsonPullReader::position() const
+{
+  return mPos;
+}
+
+void JsonPullReader::setPosition(int position)
+{
+  mPos = position;
+}
+
+JsonPullReader::Token JsonPullReader::next()
+{
+  while (mPos < mSize)
+    {
+      auto c = mData[mPos];
+      if (c != ' ' && c != '\n' && c != '\r' && c != '\t'
+          && c != ',' && c != ':')
+        {
+          break;
+        }
+      ++mPos;
+    }
+  if (mPos == mSize)
+    {
+      return NeedData;
+    }
+
+  switch (mData[mPos])
+    {
+    case '{':
+      ++mPos;
+      return BeginObject;
+    case '}':
+      ++mPos;
+      return EndObject;
+    case '[':
+      ++mPos;
+      return BeginArray;
+    case ']':
+      ++mPos;
+      return EndArray;
+    case '"':
+      return scanString();
+    case 't':
+      return scanLiteral("true", 4, True);
+    case 'f':
+      return scanLiteral("false", 5, False);
+    case 'n':
+      return scanLiteral("null", 4, Null);
+    default:
+      return scanNumber();
+    }
+}
+
+JsonPullReader::Token JsonPullReader::skipValue(Token first)
+{
+  if (first != BeginObject && first != BeginArray)
+    {
+      return first == EndObject || first == EndArray ? Invalid : first;
+    }
+  int depth = 1;
+  Q_FOREVER {
+    auto token = next();
+    switch (token)
+      {
+      case Invalid:
+      case NeedData:
+        return token;
+      case BeginObject:
+      case BeginArray:
+        ++depth;
+        break;
+      case EndObject:
+      case EndArray:
+        if (--depth == 0)
+          {
+            return token;
+          }
+        break;
+      default:
+        break;
+      }
+  }
+}
+
+JsonPullReader::Token JsonPullReader::scanString()
+{
+  bool escaped = false;
+  int i = mPos + 1;
+  while (i < mSize)
+    {
+      auto c = mData[i];
+      if (c == '\\')
+        {
+          escaped = true;
+          i += 2;
+          continue;
+        }
+      if (c == '"')
+        {
+          mTokenStart = mPos + 1;
+          mTokenEnd = i;
+          mEscaped = escaped;
+          mPos = i + 1;
+          return String;
+        }
+      ++i;
+    }
+  return NeedData;
+}
+
+JsonPullReader::Token JsonPullReader::scanNumber()
+{
+  int i = mPos;
+  while (i < mSize)
+    {
+      auto c = mData[i];
+      if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.'
+            || c == 'e' || c == 'E'))
+        {
+          break;
+        }
+      ++i;
+    }
+  if (i == mPos)
+    {
+      return Invalid;
+    }
+  // The number may go on in data which has not arrived yet.
+  if (i == mSize)
+    {
+      return NeedData;
+    }
+  mTokenStart = mPos;
+  mTokenEnd = i;
+  mPos = i;
+  return Number;
+}
+
+JsonPullReader::Token JsonPullReader::scanLiteral(const char* word, int size,
+                                                  Token token)
+{
+  int available = qMin(size, mSize - mPos);
+  if (memcmp(mData + mPos, word, available) != 0)
+    {
+      return Invalid;
+    }
+  if (available < size)
+    {
+      return NeedData;
+    }
+  mPos += size;
+  return token;
+}
+
+bool JsonPullReader::isEscaped() const
+{
+  return mEscaped;
+}
+
+QLatin1String JsonPullReader::rawString() const
+{
+  return QLatin1String(mData + mTokenStart, mTokenEnd - mTokenStart);
+}
+
+bool JsonPullReader::stringEquals(const char* latin1) const
+{
+  if (mEscaped)
+    {
+      return string() == QLatin1String(latin1);
+    }
+  return rawString() == QLatin1String(latin1);
+}
+
+QString JsonPullReader::string() const
+{
+  auto p = mData + mTokenStart;
+  auto end = mData + mTokenEnd;
+  if (!mEscaped)
+    {
+      return QString::fromUtf8(p, int(end - p));
+    }
+
+  QString result;
+  while (p != end)
+    {
+      auto run = p;
+      while (p != end && *p != '\\')
+        {
+          ++p;
+        }
+      result += QString::fromUtf8(run, int(p - run));
+      if (p == end)
+        {
+          break;
+        }
+      ++p;
+      switch (*p++)
+        {
+        case 'n':
+          result += QLatin1Char('\n');
+          break;
+        case 't':
+          result += QLatin1Char('\t');
+          break;
+        case 'r':
+          result += QLatin1Char('\r');
+          break;
+        case 'b':
+          result += QLatin1Char('\b');
+          break;
+        case 'f':
+          result += QLatin1Char('\f');
+          break;
+        case 'u':
+          // Surrogate pairs arrive as two escapes, appended in turn.
+          if (end - p >= 4)
+            {
+              result += QChar(QByteArray::fromRawData(p, 4).toUShort(nullptr, 16));
+              p += 4;
+            }
+          break;
+        default:
+          result += QLatin1Char(p[-1]);
+        }
+    }
+  return result;
+}
+
+double JsonPullReader::number() const
+{
+  return QByteArray(mData + mTokenStart, mTokenEnd - mTokenStart).toDouble();
+}
+
+int JsonPullReader::toInt() const
+{
+  auto p = mData + mTokenStart;
+  auto end = mData + mTokenEnd;
+  bool negative = p != end && *p == '-';
+  if (negative)
+    {
+      ++p;
+    }
+  qint64 value = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p)
+    {
+      value = value * 10 + (*p - '0');
+    }
+  if (p != end)
+    {
+      // A fraction or exponent.
+      return int(number());
+    }
+  return int(negative ? -value : value);
+}
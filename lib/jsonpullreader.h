@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QString>
+
+// Reads JSON text one token at a time, without building a document.  The
+// text may be incomplete: a token cut off by the end of the data is
+// reported as NeedData, and reading can resume from a saved position once
+// setData() has been given more of the same text.
+//
+// Commas and colons are treated as whitespace, so the caller tracks
+// whether an object member's key or value comes next.
+class JsonPullReader
+{
+public:
+  enum Token {
+    Invalid,
+    NeedData,
+    BeginObject,
+    EndObject,
+    BeginArray,
+    EndArray,
+    String,
+    Number,
+    True,
+    False,
+    Null
+  };
+
+  // The text so far; it must start with the text given before.
+  void setData(const char* data, int size);
+
+  int position() const;
+  void setPosition(int position);
+
+  Token next();
+  // Skips the rest of the value whose first token was just read.  Returns
+  // its last token, NeedData or Invalid.
+  Token skipValue(Token first);
+
+  // The last String token.  The raw form is its UTF-8 text as it appears,
+  // which equals the string unless it contains escapes.
+  QString string() const;
+  bool isEscaped() const;
+  QLatin1String rawString() const;
+  bool stringEquals(const char* latin1) const;
+
+  // The last Number token.
+  double number() const;
+  int toInt() const;
+
+private:
+  Token scanString();
+  Token scanNumber();
+  Token scanLiteral(const char* word, int size, Token token);
+
+private:
+  const char* mData = nullptr;
+  int mSize = 0;
+  int mPos = 0;
+  int mTokenStart = 0;
+  int mTokenEnd = 0;
+  bool mEscaped = false;
+};
@@ -0,0 +1,198 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "jsonwriter.h"
+
+namespace
+{
+
+const char hexDigits[] = "0123456789abcdef";
+
+}
+
+JsonWriter::JsonWriter(int capacity)
+{
+  mBuffer.reserve(capacity);
+}
+
+void JsonWriter::clear()
+{
+  // With capacity reserved, shrinking keeps the allocation.
+  mBuffer.resize(0);
+  mNeedComma = false;
+}
+
+void JsonWriter::reserve(int size)
+{
+  if (size > mBuffer.capacity())
+    {
+      mBuffer.reserve(size);
+    }
+}
+
+void JsonWriter::separate()
+{
+  if (mNeedComma)
+    {
+      mBuffer += ',';
+    }
+  mNeedComma = true;
+}
+
+void JsonWriter::beginObject()
+{
+  separate();
+  mBuffer += '{';
+  mNeedComma = false;
+}
+
+void JsonWriter::endObject()
+{
+  mBuffer += '}';
+  mNeedComma = true;
+}
+
+void JsonWriter::beginArray()
+{
+  separate();
+  mBuffer += '[';
+  mNeedComma = false;
+}
+
+void JsonWriter::endArray()
+{
+  mBuffer += ']';
+  mNeedComma = true;
+}
+
+void JsonWriter::key(QLatin1String name)
+{
+  separate();
+  mBuffer += '"';
+  mBuffer.append(name.data(), name.size());
+  mBuffer += "\":";
+  mNeedComma = false;
+}
+
+void JsonWriter::value(const QString& str)
+{
+  separate();
+  appendString(mBuffer, str);
+}
+
+void JsonWriter::value(QLatin1String str)
+{
+  // Only used for names and types, which need no escaping.
+  separate();
+  mBuffer += '"';
+  mBuffer.append(str.data(), str.size());
+  mBuffer += '"';
+}
+
+void JsonWriter::value(int number)
+{
+  separate();
+  mBuffer += QByteArray::number(number);
+}
+
+void JsonWriter::appendRaw(const char* data, int size)
+{
+  mBuffer.append(data, size);
+}
+
+const QByteArray& JsonWriter::data() const
+{
+  return mBuffer;
+}
+
+void JsonWriter::appendString(QByteArray& out, const QString& str)
+{
+  // Grow once for the worst case, six bytes for an escaped control
+  // character, then write through a pointer and trim to what was used.
+  auto start = out.size();
+  out.resize(start + 6 * str.size() + 2);
+  auto dst = out.data() + start;
+  *dst++ = '"';
+
+  auto src = reinterpret_cast<const ushort*>(str.constData());
+  auto end = src + str.size();
+  while (src != end)
+    {
+      ushort c = *src++;
+      if (c >= 0x20 && c < 0x80)
+        {
+          if (c == '"' || c == '\\')
+            {
+              *dst++ = '\\';
+            }
+          *dst++ = char(c);
+        }
+      else if (c < 0x20)
+        {
+          *dst++ = '\\';
+          switch (c)
+            {
+            case '\n':
+              *dst++ = 'n';
+              break;
+            case '\t':
+              *dst++ = 't';
+              break;
+            case '\r':
+              *dst++ = 'r';
+              break;
+            default:
+              *dst++ = 'u';
+              *dst++ = '0';
+              *dst++ = '0';
+              *dst++ = hexDigits[c >> 4];
+              *dst++ = hexDigits[c & 0xf];
+            }
+        }
+      else if (c < 0x800)
+        {
+          *dst++ = char(0xc0 | (c >> 6));
+          *dst++ = char(0x80 | (c & 0x3f));
+        }
+      else if (QChar::isHighSurrogate(c) && src != end
+               && QChar::isLowSurrogate(*src))
+        {
+          uint ucs4 = QChar::surrogateToUcs4(c, *src++);
+          *dst++ = char(0xf0 | (ucs4 >> 18));
+          *dst++ = char(0x80 | ((ucs4 >> 12) & 0x3f));
+          *dst++ = char(0x80 | ((ucs4 >> 6) & 0x3f));
+          *dst++ = char(0x80 | (ucs4 & 0x3f));
+        }
+      else
+        {
+          // A lone surrogate is written as U+FFFD, as QString::toUtf8()
+          // does.
+          if (QChar::isSurrogate(c))
+            {
+              c = QChar::ReplacementCharacter;
+            }
+          *dst++ = char(0xe0 | (c >> 12));
+          *dst++ = char(0x80 | ((c >> 6) & 0x3f));
+          *dst++ = char(0x80 | (c & 0x3f));
+        }
+    }
+
+  *dst++ = '"';
+  out.resize(int(dst - out.constData()));
+}
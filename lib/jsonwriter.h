@@ -0,0 +1,77 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+// Writes compact JSON into a buffer which keeps its capacity from one
+// document to the next.  Strings are escaped straight from UTF-16 into the
+// buffer, without an intermediate UTF-8 copy.  Commas are inserted between
+// members and elements; the caller is responsible for nesting.
+class JsonWriter
+{
+public:
+  explicit JsonWriter(int capacity = 4096);
+
+  // Empties the buffer, keeping its capacity.
+  void clear();
+  void reserve(int size);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  void key(QLatin1String name);
+  void value(const QString& str);
+  void value(QLatin1String str);
+  void value(int number);
+
+  void field(QLatin1String name, const QString& str)
+  {
+    key(name);
+    value(str);
+  }
+  void field(QLatin1String name, QLatin1String str)
+  {
+    key(name);
+    value(str);
+  }
+  void field(QLatin1String name, int number)
+  {
+    key(name);
+    value(number);
+  }
+
+  // Appends bytes as they are, outside of the JSON structure.
+  void appendRaw(const char* data, int size);
+
+  const QByteArray& data() const;
+
+  static void appendString(QByteArray& out, const QString& str);
+
+private:
+  void separate();
+
+private:
+  QByteArray mBuffer;
+  bool mNeedComma = false;
+};
@@ -19,6 +19,10 @@
 
 #include "projectmodel.h"
 #include "cmakeclient.h"
+#include "futures.h"
+#include "projectsnapshot.h"
+#include "resultsstore.h"
+#include "tracing.h"
 
 #include <QDir>
 #include <QPixmap>
@@ -28,7 +32,8 @@ ProjectModel::ProjectModel(CMakeClient* client, QObject *parent)
   : QAbstractItemModel(parent), mClient(client)
 {
   auto requestTargets = [this](){
-      if (m_data.childItems.isEmpty()
+      if ((m_data.childItems.isEmpty() || mShowingSnapshot
+           || mTargetsGeneration != mClient->generation())
           && mClient->GetState() == CMakeClient::Idle)
         {
           mClient->retrieveTargets();
@@ -37,19 +42,72 @@ ProjectModel::ProjectModel(CMakeClient* client, QObject *parent)
   connect(mClient, &CMakeClient::stateChanged, this, requestTargets);
   auto handleTargets = [this](QStringList const& configs,
       QVector<CMakeTarget> const& targets){
+      mConfigs = configs;
+      if (!mConfigs.contains(mConfig))
+        {
+          mConfig = mConfigs.value(0);
+        }
+      mTargetsGeneration = mClient->generation();
+      Q_EMIT configsChanged();
+
+      // The live targets usually match the snapshot being shown, in which
+      // case the tree is kept and only the sources are refreshed.
+      if (mShowingSnapshot && targets == mSnapshotTargets)
+        {
+          mShowingSnapshot = false;
+          mSnapshotTargets.clear();
+          requestSources();
+          return;
+        }
+      mShowingSnapshot = false;
+      mSnapshotTargets.clear();
+      bool shownAlready = mArriving && targets == mArrivedTargets;
+      mArriving = false;
+      mArrivedTargets.clear();
+      if (shownAlready)
+        {
+          requestSources();
+          return;
+        }
+      CMK_TRACE_SCOPE("model", "reset from targets");
       beginResetModel();
-      setDataFromTargets(targets);
+      setDataFromTargets(targets, mClient->sourceDir(), mClient->projectName());
       endResetModel();
+      requestSources();
     };
   connect(mClient, &CMakeClient::targetsRetrieved, this, handleTargets);
+  connect(mClient, &CMakeClient::targetsArriving,
+          this, &ProjectModel::showArrivingTargets);
+  // The tree stays until the targets of the new configuration replace it.
+  connect(mClient, &CMakeClient::generationChanged, this, [this] {
+      // A reply still arriving is dropped; the next one starts afresh.
+      mArriving = false;
+      mArrivedTargets.clear();
+      for (auto& batch : mSourceBatches)
+        {
+          batch.cancel();
+        }
+      mSourceBatches.clear();
+    });
   requestTargets();
+}
 
-  connect(mClient, &CMakeClient::sourcesRetrieved, this,
-          [this](QString tgt, QStringList srcs) {
-      beginResetModel();
-      addSourcesToTarget(tgt, srcs);
-      endResetModel();
-  });
+void ProjectModel::loadSnapshot(const ProjectSnapshot& snapshot)
+{
+  CMK_TRACE_SCOPE("model", "reset from snapshot");
+  beginResetModel();
+  setDataFromTargets(snapshot.Targets, snapshot.SourceDir,
+                     snapshot.ProjectName);
+  for (auto const& info : snapshot.TargetInfo)
+    {
+      if (auto id = targetId(info.Name))
+        {
+          addSourcesToTarget(id, info.Sources);
+        }
+    }
+  endResetModel();
+  mSnapshotTargets = snapshot.Targets;
+  mShowingSnapshot = true;
 }
 
 std::vector<CMakeTarget> ProjectModel::GetTargets() const
@@ -84,8 +142,8 @@ quintptr ProjectModel::parentId(const QString& path_)
       auto newId = m_nextId++;
       auto loc = path + "/CMakeLists.txt";
       auto pid = parentId(loc);
-      m_data.childItems[pid].append(newId);
       m_data.locations[newId] = loc;
+      appendChild(pid, newId);
       return newId;
     }
     QFileInfo fi(path);
@@ -94,95 +152,308 @@ quintptr ProjectModel::parentId(const QString& path_)
   return 1;
 }
 
+void ProjectModel::appendChild(quintptr parent, quintptr child)
+{
+  // Items are added below the root, which is in place, so the parent is
+  // always shown already.
+  if (mNotifyInserts)
+    {
+      auto row = m_data.childItems.value(parent).size();
+      beginInsertRows(parent == 0 ? QModelIndex() : indexForId(parent),
+                      row, row);
+    }
+  m_data.childItems[parent].append(child);
+  m_data.parents.insert(child, parent);
+  if (mNotifyInserts)
+    {
+      endInsertRows();
+    }
+}
+
 void ProjectModel::addSourcesToTarget(quintptr id, QStringList srcs)
 {
+  for (auto srcId : m_data.childItems.value(id))
+    {
+      auto owners = m_data.sourceOwners.find(
+            QDir::cleanPath(m_data.Sources.value(srcId)));
+      if (owners != m_data.sourceOwners.end())
+        {
+          owners->removeOne(id);
+          if (owners->isEmpty())
+            {
+              m_data.sourceOwners.erase(owners);
+            }
+        }
+      m_data.Sources.remove(srcId);
+      m_data.locations.remove(srcId);
+      m_data.parents.remove(srcId);
+    }
+  m_data.childItems.remove(id);
   for (auto src: srcs)
   {
     auto srcId = m_nextId++;
-    m_data.childItems[id].append(srcId);
+    appendChild(id, srcId);
     m_data.Sources[srcId] = src;
     m_data.locations[srcId] = src;
+    m_data.sourceOwners[QDir::cleanPath(src)].append(id);
   }
 }
 
-void ProjectModel::addSourcesToTarget(const QString& tgtName, QStringList srcs)
+QVector<quintptr> ProjectModel::ownersOf(const QString& path) const
 {
-  qDebug() << tgtName;
-  for (auto it = m_data.childItems.begin(); it != m_data.childItems.end(); ++it)
-  {
-    for (auto i = it.value().begin(); i < it.value().end(); ++i)
-      {
-      if (m_data.targets.contains(*i))
+  auto it = m_data.sourceOwners.constFind(QDir::cleanPath(path));
+  if (it == m_data.sourceOwners.constEnd())
+    {
+      // The document may have been opened through a symlink.
+      it = m_data.sourceOwners.constFind(QFileInfo(path).canonicalFilePath());
+    }
+  return it == m_data.sourceOwners.constEnd() ? QVector<quintptr>() : it.value();
+}
+
+QStringList ProjectModel::targetsForSource(const QString& path) const
+{
+  QStringList names;
+  for (auto id : ownersOf(path))
+    {
+      names.append(m_data.targets.value(id).Name);
+    }
+  return names;
+}
+
+QModelIndex ProjectModel::indexForSource(const QString& path) const
+{
+  auto owners = ownersOf(path);
+  if (owners.isEmpty())
+    {
+      return QModelIndex();
+    }
+  auto cleanPath = QDir::cleanPath(path);
+  for (auto srcId : m_data.childItems.value(owners.first()))
+    {
+      if (QDir::cleanPath(m_data.Sources.value(srcId)) == cleanPath)
         {
-        if (m_data.targets[*i].Name == tgtName)
-          {
-            addSourcesToTarget(it.key(), srcs);
-            break;
-          }
+          return indexForId(srcId);
         }
-      }
-  }
+    }
+  return indexForId(owners.first());
+}
+
+QModelIndex ProjectModel::indexForId(quintptr id) const
+{
+  auto parent = m_data.parents.constFind(id);
+  if (parent == m_data.parents.constEnd())
+    {
+      return QModelIndex();
+    }
+  auto row = m_data.childItems.value(parent.value()).indexOf(id);
+  return createIndex(row, 0, parent.value());
+}
+
+quintptr ProjectModel::targetId(const QString& tgtName) const
+{
+  return m_data.targetIds.value(tgtName);
+}
+
+QStringList ProjectModel::sourcesOfTarget(quintptr id) const
+{
+  QStringList srcs;
+  for (auto srcId : m_data.childItems.value(id))
+    {
+      srcs.append(m_data.Sources.value(srcId));
+    }
+  return srcs;
 }
 
-void ProjectModel::setDataFromTargets(const QVector<CMakeTarget>& targets)
+void ProjectModel::requestSources()
+{
+  // Whatever is still queued for the previous targets is of no use now.
+  for (auto& batch : mSourceBatches)
+    {
+      batch.cancel();
+    }
+  mSourceBatches.clear();
+
+  // All configurations are requested up front, the one shown first; the
+  // daemon answers them back to back and each is added as a whole.
+  auto configs = mConfigs.isEmpty() ? QStringList(QString()) : mConfigs;
+  configs.move(qMax(0, configs.indexOf(mConfig)), 0);
+  for (auto const& config : configs)
+    {
+      QVector<QFuture<CMakeTargetInfo> > requests;
+      requests.reserve(m_data.targets.size());
+      for (auto const& target : m_data.targets)
+        {
+          requests.append(mClient->retrieveSources(target.Name, config));
+        }
+      auto batch = whenAll(requests, this);
+      auto generation = mClient->generation();
+      onFinished(batch, this, [this, generation](
+                 const QFuture<CMakeTargetInfo>& done) {
+          if (!done.isCanceled() && generation == mClient->generation())
+            {
+              showSources(done.results());
+            }
+        });
+      mSourceBatches.append(batch);
+    }
+}
+
+void ProjectModel::showSources(const QList<CMakeTargetInfo>& infos)
+{
+  CMK_TRACE_SCOPE("model", "insert sources");
+  bool resetting = false;
+  for (auto const& info : infos)
+    {
+      if (info.Config != mConfig)
+        {
+          continue;
+        }
+      auto id = targetId(info.Name);
+      if (!id || sourcesOfTarget(id) == info.Sources)
+        {
+          continue;
+        }
+      if (!resetting)
+        {
+          beginResetModel();
+          resetting = true;
+        }
+      addSourcesToTarget(id, info.Sources);
+    }
+  if (resetting)
+    {
+      endResetModel();
+    }
+}
+
+QStringList ProjectModel::configs() const
+{
+  return mConfigs;
+}
+
+QString ProjectModel::config() const
+{
+  return mConfig;
+}
+
+void ProjectModel::setConfig(const QString& config)
+{
+  if (config == mConfig)
+    {
+      return;
+    }
+  mConfig = config;
+
+  CMK_TRACE_SCOPE("model", "switch config");
+  beginResetModel();
+  for (auto it = m_data.targets.constBegin(); it != m_data.targets.constEnd(); ++it)
+    {
+      auto const& targetInfo = mClient->results().targetInfo();
+      if (targetInfo.contains(it->Name, mConfig))
+        {
+          addSourcesToTarget(it.key(), targetInfo.info(it->Name, mConfig).Sources);
+        }
+    }
+  endResetModel();
+  Q_EMIT configsChanged();
+}
+
+void ProjectModel::setDataFromTargets(const QVector<CMakeTarget>& targets,
+                                      const QString& srcDir,
+                                      const QString& projectName)
 {
   m_data = ProjectData();
-  QString srcDir = mClient->sourceDir();
   m_data.srcLocation = QDir::cleanPath(srcDir + "/CMakeLists.txt");
 
-  m_data.projectName = mClient->projectName();
+  m_data.projectName = projectName;
 
   m_nextId = 1;
 
   m_data.locations[m_nextId++] = m_data.srcLocation;
+  appendChild(0, 1);
 
   foreach(auto& target, targets) {
-    if (target.Type != CMakeTarget::UTILITY) {
-      QString location;
-      int btIndex = 0;
-      for ( ; btIndex < target.Backtrace.size(); ++btIndex) {
-        QString btPath = srcDir + "/" + target.Backtrace[btIndex].first;
-        if (btPath.endsWith("/CMakeLists.txt")) {
-          auto ifo = QFileInfo(btPath);
-          location = ifo.canonicalFilePath();
-          break;
-        }
-      }
-      if (location.isEmpty())
-        continue;
-
-      QFileInfo fi(location);
-      auto dir = fi.canonicalPath();
-
-      quintptr pid = 1;
-      bool found = false;
-      for(auto it = m_data.locations.begin(); it != m_data.locations.end(); ++it) {
-        QFileInfo fit(it.value());
-        if (fit.canonicalPath() == dir) {
-          pid = it.key();
-          found = true;
-          break;
-        }
-      }
-      if (!found) {
-        pid = m_nextId++;
-        auto lpid = parentId(location);
-        m_data.childItems[lpid].append(pid);
-        m_data.locations[pid] = location;
-      }
-
-      auto tgtId = m_nextId++;
-      m_data.childItems[pid].append(tgtId);
-      m_data.targets[tgtId].Name = target.Name;
-      m_data.targets[tgtId].Type = target.Type;
+    addTarget(target);
+  }
+}
 
-      m_data.targets[tgtId].Path = location;
-      m_data.targets[tgtId].Line = target.Backtrace[btIndex].second - 1;
+void ProjectModel::addTarget(const CMakeTarget& target)
+{
+  if (target.Type == CMakeTarget::UTILITY)
+    return;
 
-      mClient->retrieveSources(target.Name);
+  auto srcDir = QFileInfo(m_data.srcLocation).path();
+  QString location;
+  int btIndex = 0;
+  for ( ; btIndex < target.Backtrace.size(); ++btIndex) {
+    QString btPath = srcDir + "/" + target.Backtrace[btIndex].first;
+    if (btPath.endsWith("/CMakeLists.txt")) {
+      auto ifo = QFileInfo(btPath);
+      location = ifo.canonicalFilePath();
+      break;
+    }
+  }
+  if (location.isEmpty())
+    return;
+
+  QFileInfo fi(location);
+  auto dir = fi.canonicalPath();
+
+  quintptr pid = 1;
+  bool found = false;
+  for(auto it = m_data.locations.begin(); it != m_data.locations.end(); ++it) {
+    QFileInfo fit(it.value());
+    if (fit.canonicalPath() == dir) {
+      pid = it.key();
+      found = true;
+      break;
     }
   }
-  m_data.childItems[0].push_back(1);
+  if (!found) {
+    pid = m_nextId++;
+    auto lpid = parentId(location);
+    m_data.locations[pid] = location;
+    appendChild(lpid, pid);
+  }
+
+  // Everything shown for the item is in place before it is added.
+  auto tgtId = m_nextId++;
+  m_data.targetIds.insert(target.Name, tgtId);
+  m_data.targets[tgtId].Name = target.Name;
+  m_data.targets[tgtId].Type = target.Type;
+
+  m_data.targets[tgtId].Path = location;
+  m_data.targets[tgtId].Line = target.Backtrace[btIndex].second - 1;
+  appendChild(pid, tgtId);
+}
+
+void ProjectModel::showArrivingTargets(const QVector<CMakeTarget>& targets)
+{
+  // A snapshot stays until the whole reply can be compared with it, and an
+  // up to date tree is not rebuilt for a reply someone else asked for.
+  if (mShowingSnapshot
+      || (!mArriving && !m_data.childItems.isEmpty()
+          && mTargetsGeneration == mClient->generation()))
+    {
+      return;
+    }
+  if (!mArriving)
+    {
+      mArriving = true;
+      beginResetModel();
+      setDataFromTargets(QVector<CMakeTarget>(), mClient->sourceDir(),
+                         mClient->projectName());
+      endResetModel();
+    }
+
+  CMK_TRACE_SCOPE("model", "insert arriving targets");
+  mNotifyInserts = true;
+  for (auto const& target : targets)
+    {
+      mArrivedTargets.append(target);
+      addTarget(target);
+    }
+  mNotifyInserts = false;
 }
 
 int ProjectModel::rowCount(const QModelIndex& parent) const
@@ -243,13 +514,7 @@ QModelIndex ProjectModel::parent(const QModelIndex& index) const
       return QModelIndex();
     }
 
-  for(auto it = m_data.childItems.begin(); it != m_data.childItems.end(); ++it) {
-    auto position = it.value().indexOf(id);
-    if (position != -1) {
-        return createIndex(position, 0, it.key());
-    }
-  }
-  return QModelIndex();
+  return indexForId(id);
 }
 
 QVariant ProjectModel::data(const QModelIndex& index, int role) const
@@ -21,10 +21,14 @@
 
 #include <QAbstractItemModel>
 
+#include <QFuture>
+
+#include "cmakeclient.h"
 #include "utility.h"
 
 class CMakeClient;
 class CMakeTarget;
+class ProjectSnapshot;
 
 struct Target
 {
@@ -74,6 +78,10 @@ public:
   QHash<quintptr, QString> locations;
   QHash<quintptr, QVector<quintptr> > childItems;
   QHash<quintptr, QString> Sources;
+  // Derived from the above for constant time lookups.
+  QHash<quintptr, quintptr> parents;
+  QHash<QString, quintptr> targetIds;
+  QHash<QString, QVector<quintptr> > sourceOwners;
   QString buildDir;
   QString srcLocation;
   QString cmakeExe;
@@ -102,22 +110,60 @@ public:
 
   std::vector<CMakeTarget> GetTargets() const;
 
+  // Shows the tree from a snapshot until the daemon has answered.
+  void loadSnapshot(const ProjectSnapshot& snapshot);
+
+  // The sources shown are those of one configuration; switching uses the
+  // target_info already fetched for all of them.
+  QStringList configs() const;
+  QString config() const;
+  void setConfig(const QString& config);
+
+  // The targets which build the source, and the item showing it under the
+  // first of them.
+  QStringList targetsForSource(const QString& path) const;
+  QModelIndex indexForSource(const QString& path) const;
+
   int rowCount(const QModelIndex& parent = QModelIndex()) const override;
   int columnCount(const QModelIndex& parent = QModelIndex()) const override;
   QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
   QModelIndex parent(const QModelIndex& parent) const override;
   QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
+Q_SIGNALS:
+  void configsChanged();
+
 private:
-  void setDataFromTargets(const QVector<CMakeTarget>& targets);
+  void setDataFromTargets(const QVector<CMakeTarget>& targets,
+                          const QString& srcDir, const QString& projectName);
+  void addTarget(const CMakeTarget& target);
+  void showArrivingTargets(const QVector<CMakeTarget>& targets);
   quintptr parentId(const QString& path_);
+  void appendChild(quintptr parent, quintptr child);
+  QModelIndex indexForId(quintptr id) const;
+  QVector<quintptr> ownersOf(const QString& path) const;
 
   void addSourcesToTarget(quintptr id, QStringList srcs);
-  void addSourcesToTarget(const QString& tgtName, QStringList srcs);
+  quintptr targetId(const QString& tgtName) const;
+  QStringList sourcesOfTarget(quintptr id) const;
+  void requestSources();
+  void showSources(const QList<CMakeTargetInfo>& infos);
 
 private:
   ProjectData m_data;
   CMakeClient* mClient;
   QStringList mConfigs;
+  QString mConfig;
+  // The generation of the targets shown.
+  quint32 mTargetsGeneration = 0;
+  // The target_info requests for the current targets, one batch per config.
+  QVector<QFuture<CMakeTargetInfo> > mSourceBatches;
+  QVector<CMakeTarget> mSnapshotTargets;
+  bool mShowingSnapshot = false;
+  // The targets of a buildsystem reply shown while it is still arriving.
+  QVector<CMakeTarget> mArrivedTargets;
+  bool mArriving = false;
+  // Whether appendChild() tells the views of each row it adds.
+  bool mNotifyInserts = false;
   long m_nextId = 1;
 };
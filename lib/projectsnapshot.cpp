@@ -0,0 +1,394 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "projectsnapshot.h"
+
+#include "tracing.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace
+{
+
+const char snapshotMagic[8] = { 'C', 'M', 'K', 'S', 'N', 'A', 'P', '\0' };
+const quint32 headerSize = 32;
+
+class SnapshotWriter
+{
+public:
+  void add(quint32 value)
+  {
+    mRecords.append(value);
+  }
+
+  void addString(const QString& str)
+  {
+    auto it = mIds.constFind(str);
+    if (it == mIds.constEnd())
+      {
+        it = mIds.insert(str, mStrings.size());
+        mStrings.append(str);
+      }
+    add(it.value());
+  }
+
+  void addList(const QStringList& list)
+  {
+    add(list.size());
+    for (auto const& str : list)
+      {
+        addString(str);
+      }
+  }
+
+  QByteArray finish() const
+  {
+    quint32 indexOffset = headerSize;
+    quint32 recordsOffset = indexOffset + 8 * mStrings.size();
+    quint32 dataOffset = recordsOffset + 4 * mRecords.size();
+
+    quint32 dataSize = 0;
+    for (auto const& str : mStrings)
+      {
+        dataSize += (2 * str.size() + 3) & ~3u;
+      }
+
+    QByteArray result(dataOffset + dataSize, '\0');
+    auto out = reinterpret_cast<uchar*>(result.data());
+
+    memcpy(out, snapshotMagic, sizeof(snapshotMagic));
+    qToLittleEndian<quint32>(ProjectSnapshot::formatVersion, out + 8);
+    qToLittleEndian<quint32>(mStrings.size(), out + 12);
+    qToLittleEndian<quint32>(indexOffset, out + 16);
+    qToLittleEndian<quint32>(recordsOffset, out + 20);
+    qToLittleEndian<quint32>(mRecords.size(), out + 24);
+
+    quint32 offset = dataOffset;
+    for (int i = 0; i < mStrings.size(); ++i)
+      {
+        auto const& str = mStrings.at(i);
+        qToLittleEndian<quint32>(offset, out + indexOffset + 8 * i);
+        qToLittleEndian<quint32>(str.size(), out + indexOffset + 8 * i + 4);
+        for (int c = 0; c < str.size(); ++c)
+          {
+            qToLittleEndian<quint16>(str.at(c).unicode(), out + offset + 2 * c);
+          }
+        offset += (2 * str.size() + 3) & ~3u;
+      }
+
+    for (int i = 0; i < mRecords.size(); ++i)
+      {
+        qToLittleEndian<quint32>(mRecords.at(i), out + recordsOffset + 4 * i);
+      }
+    return result;
+  }
+
+private:
+  QHash<QString, quint32> mIds;
+  QVector<QString> mStrings;
+  QVector<quint32> mRecords;
+};
+
+class SnapshotReader
+{
+public:
+  SnapshotReader(const uchar* data, quint32 size)
+    : mData(data), mSize(size)
+  {
+    if (size < headerSize || memcmp(data, snapshotMagic, 8) != 0
+        || qFromLittleEndian<quint32>(data + 8)
+           != ProjectSnapshot::formatVersion)
+      {
+        mOk = false;
+        return;
+      }
+    mStringCount = qFromLittleEndian<quint32>(data + 12);
+    auto indexOffset = qFromLittleEndian<quint32>(data + 16);
+    auto recordsOffset = qFromLittleEndian<quint32>(data + 20);
+    mRecordCount = qFromLittleEndian<quint32>(data + 24);
+    if (quint64(indexOffset) + 8 * quint64(mStringCount) > size
+        || quint64(recordsOffset) + 4 * quint64(mRecordCount) > size)
+      {
+        mOk = false;
+        return;
+      }
+    mIndex = data + indexOffset;
+    mRecords = data + recordsOffset;
+    mStrings.resize(mStringCount);
+  }
+
+  bool ok() const
+  {
+    return mOk;
+  }
+
+  bool atEnd() const
+  {
+    return mPos == mRecordCount;
+  }
+
+  quint32 next()
+  {
+    if (mPos >= mRecordCount)
+      {
+        mOk = false;
+        return 0;
+      }
+    return qFromLittleEndian<quint32>(mRecords + 4 * mPos++);
+  }
+
+  QString string()
+  {
+    auto id = next();
+    if (id >= mStringCount)
+      {
+        mOk = false;
+        return QString();
+      }
+    // Decode each interned string once so that the loaded data shares it.
+    auto& str = mStrings[id];
+    if (str.isNull())
+      {
+        auto offset = qFromLittleEndian<quint32>(mIndex + 8 * id);
+        auto length = qFromLittleEndian<quint32>(mIndex + 8 * id + 4);
+        if (quint64(offset) + 2 * quint64(length) > mSize)
+          {
+            mOk = false;
+            return QString();
+          }
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        str = QString(reinterpret_cast<const QChar*>(mData + offset), length);
+#else
+        str.resize(length);
+        for (quint32 c = 0; c < length; ++c)
+          {
+            str[c] = QChar(qFromLittleEndian<quint16>(mData + offset + 2 * c));
+          }
+#endif
+        if (str.isNull())
+          {
+            str = QLatin1String("");
+          }
+      }
+    return str;
+  }
+
+  QStringList list()
+  {
+    QStringList result;
+    auto count = next();
+    if (count > mRecordCount - qMin(mPos, mRecordCount))
+      {
+        mOk = false;
+        return result;
+      }
+    result.reserve(count);
+    for (quint32 i = 0; i < count; ++i)
+      {
+        result.append(string());
+      }
+    return result;
+  }
+
+private:
+  const uchar* mData;
+  quint32 mSize;
+  const uchar* mIndex = nullptr;
+  const uchar* mRecords = nullptr;
+  quint32 mStringCount = 0;
+  quint32 mRecordCount = 0;
+  quint32 mPos = 0;
+  bool mOk = true;
+  QVector<QString> mStrings;
+};
+
+}
+
+bool ProjectSnapshot::isEmpty() const
+{
+  return Targets.isEmpty();
+}
+
+QString ProjectSnapshot::fileNameFor(const QString& buildDir)
+{
+  return buildDir + QStringLiteral("/.cmakekate-snapshot");
+}
+
+bool ProjectSnapshot::save(const QString& fileName) const
+{
+  CMK_TRACE_SCOPE("snapshot", "save");
+
+  SnapshotWriter writer;
+  writer.addString(SourceDir);
+  writer.addString(ProjectName);
+  writer.add(Targets.size());
+  for (auto const& target : Targets)
+    {
+      writer.addString(target.Name);
+      writer.addString(target.Path);
+      writer.addString(target.ProjectName);
+      writer.add(target.Type);
+      writer.add(target.Line);
+      writer.add(target.Backtrace.size());
+      for (auto const& frame : target.Backtrace)
+        {
+          writer.addString(frame.first);
+          writer.add(frame.second);
+        }
+      writer.addList(target.Dependencies);
+      auto it = TargetInfo.constFind(target.Name);
+      writer.add(it != TargetInfo.constEnd());
+      if (it != TargetInfo.constEnd())
+        {
+          writer.addList(it->Sources);
+          writer.addList(it->GeneratedSources);
+          writer.addList(it->IncludeDirectories);
+          writer.addList(it->CompileDefinitions);
+        }
+    }
+
+  QSaveFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    {
+      return false;
+    }
+  auto data = writer.finish();
+  if (file.write(data) != data.size())
+    {
+      file.cancelWriting();
+      return false;
+    }
+  return file.commit();
+}
+
+bool ProjectSnapshot::load(const QString& fileName)
+{
+  CMK_TRACE_SCOPE("snapshot", "load");
+
+  *this = ProjectSnapshot();
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly) || file.size() > 0x7fffffff)
+    {
+      return false;
+    }
+  auto size = quint32(file.size());
+  auto data = file.map(0, size);
+  if (!data)
+    {
+      return false;
+    }
+
+  SnapshotReader reader(data, size);
+  if (reader.ok())
+    {
+      SourceDir = reader.string();
+      ProjectName = reader.string();
+      auto targetCount = reader.next();
+      for (quint32 i = 0; reader.ok() && i < targetCount; ++i)
+        {
+          CMakeTarget target;
+          target.Name = reader.string();
+          target.Path = reader.string();
+          target.ProjectName = reader.string();
+          auto type = reader.next();
+          target.Type = type <= CMakeTarget::UNKNOWN_LIBRARY
+              ? CMakeTarget::TargetType(type) : CMakeTarget::UNKNOWN_LIBRARY;
+          target.Line = reader.next();
+          auto frames = reader.next();
+          for (quint32 f = 0; reader.ok() && f < frames; ++f)
+            {
+              auto file = reader.string();
+              target.Backtrace.append(qMakePair(file, int(reader.next())));
+            }
+          target.Dependencies = reader.list();
+          if (reader.next())
+            {
+              CMakeTargetInfo info;
+              info.Name = target.Name;
+              info.Sources = reader.list();
+              info.GeneratedSources = reader.list();
+              info.IncludeDirectories = reader.list();
+              info.CompileDefinitions = reader.list();
+              TargetInfo.insert(info.Name, info);
+            }
+          Targets.append(target);
+        }
+    }
+  bool ok = reader.ok() && reader.atEnd();
+  file.unmap(data);
+
+  if (!ok)
+    {
+      *this = ProjectSnapshot();
+    }
+  return ok;
+}
+
+ProjectSnapshotUpdater::ProjectSnapshotUpdater(CMakeClient* client,
+                                               QObject* parent)
+  : QObject(parent), mClient(client)
+{
+  mSaveTimer = new QTimer(this);
+  mSaveTimer->setSingleShot(true);
+  mSaveTimer->setInterval(1000);
+  connect(mSaveTimer, &QTimer::timeout, this, &ProjectSnapshotUpdater::save);
+
+  // Whatever was learned before a reconfigure may be stale now.
+  connect(mClient, &CMakeClient::generationChanged, this, [this] {
+      mSaveTimer->stop();
+      mSnapshot = ProjectSnapshot();
+    });
+  connect(mClient, &CMakeClient::targetsRetrieved, this,
+          [this](QStringList const& configs,
+                 QVector<CMakeTarget> const& targets) {
+      mConfig = configs.value(0);
+      mSnapshot.SourceDir = mClient->sourceDir();
+      mSnapshot.ProjectName = mClient->projectName();
+      mSnapshot.Targets = targets;
+      mSaveTimer->start();
+    });
+  connect(mClient, &CMakeClient::targetInfoRetrieved, this,
+          [this](CMakeTargetInfo const& info) {
+      // The snapshot holds the first configuration only.
+      if (info.Config != mConfig)
+        {
+          return;
+        }
+      mSnapshot.TargetInfo[info.Name] = info;
+      mSaveTimer->start();
+    });
+}
+
+void ProjectSnapshotUpdater::save()
+{
+  // A replayed recording has no cmake of its own and must not overwrite
+  // the snapshot of the build it was recorded from.
+  if (mSnapshot.isEmpty() || mClient->buildDir().isEmpty()
+      || mClient->cmakeExecutable().isEmpty())
+    {
+      return;
+    }
+  mSnapshot.save(ProjectSnapshot::fileNameFor(mClient->buildDir()));
+}
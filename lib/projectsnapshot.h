@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include "cmakeclient.h"
+
+#include <QObject>
+
+class QTimer;
+
+// The decoded buildsystem and target_info replies of a build directory, as
+// last seen from the daemon.
+//
+// The file is laid out so that it can be mapped and walked in place:
+//
+//   char    magic[8]           "CMKSNAP\0"
+//   quint32 version
+//   quint32 stringCount
+//   quint32 stringIndexOffset  stringCount x { quint32 offset, quint32 size }
+//   quint32 recordsOffset      recordsSize x quint32
+//   quint32 recordsSize
+//   quint32 reserved
+//   string data                UTF-16, each string 4 byte aligned
+//
+// Offsets are from the start of the file and all integers are little
+// endian.  Strings are interned, so the include directories and defines
+// shared by most targets are stored once.  The records are a flat sequence
+// of string ids and counts:
+//
+//   sourceDir projectName
+//   targetCount, per target:
+//     name path projectName type line
+//     backtraceCount, backtraceCount x { file line }
+//     dependencyCount, dependencyCount x name
+//     hasInfo, if set: four lists (sources, generated sources,
+//     include directories, defines) each as count followed by string ids
+class ProjectSnapshot
+{
+public:
+  QString SourceDir;
+  QString ProjectName;
+  QVector<CMakeTarget> Targets;
+  QHash<QString, CMakeTargetInfo> TargetInfo;
+
+  bool isEmpty() const;
+
+  bool load(const QString& fileName);
+  bool save(const QString& fileName) const;
+
+  static QString fileNameFor(const QString& buildDir);
+
+  static const quint32 formatVersion = 2;
+};
+
+// Keeps the snapshot of a client's build directory up to date.  Replies are
+// collected as they arrive and written shortly after the last one, so a
+// full round of target_info replies results in a single write.
+class ProjectSnapshotUpdater : public QObject
+{
+  Q_OBJECT
+public:
+  ProjectSnapshotUpdater(CMakeClient* client, QObject* parent = 0);
+
+private:
+  void save();
+
+private:
+  CMakeClient* mClient;
+  ProjectSnapshot mSnapshot;
+  QString mConfig;
+  QTimer* mSaveTimer;
+};
@@ -0,0 +1,138 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "protocolrecorder.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+#include <cstring>
+
+ProtocolRecorder::ProtocolRecorder(int capacity)
+{
+  mRing.resize(capacity);
+  mClock.start();
+}
+
+const char* ProtocolRecorder::magic()
+{
+  return "CMKREC";
+}
+
+void ProtocolRecorder::write(int offset, const char* data, int size)
+{
+  int first = qMin(size, mRing.size() - offset);
+  memcpy(mRing.data() + offset, data, first);
+  memcpy(mRing.data(), data + first, size - first);
+}
+
+void ProtocolRecorder::read(int offset, char* data, int size) const
+{
+  int first = qMin(size, mRing.size() - offset);
+  memcpy(data, mRing.constData() + offset, first);
+  memcpy(data + first, mRing.constData(), size - first);
+}
+
+void ProtocolRecorder::dropOldest()
+{
+  Header header;
+  read(mBegin, reinterpret_cast<char*>(&header), sizeof(header));
+  int recordSize = sizeof(header) + header.size;
+  mBegin = (mBegin + recordSize) % mRing.size();
+  mUsed -= recordSize;
+  --mCount;
+}
+
+void ProtocolRecorder::record(Direction direction, const char* data, int size)
+{
+  int recordSize = sizeof(Header) + size;
+  if (recordSize > mRing.size())
+    {
+      return;
+    }
+  while (mUsed + recordSize > mRing.size())
+    {
+      dropOldest();
+    }
+
+  Header header;
+  header.timestampUs = mClock.nsecsElapsed() / 1000;
+  header.size = size;
+  header.direction = direction;
+
+  int offset = (mBegin + mUsed) % mRing.size();
+  write(offset, reinterpret_cast<const char*>(&header), sizeof(header));
+  write((offset + sizeof(header)) % mRing.size(), data, size);
+  mUsed += recordSize;
+  ++mCount;
+}
+
+void ProtocolRecorder::clear()
+{
+  mBegin = 0;
+  mUsed = 0;
+  mCount = 0;
+}
+
+int ProtocolRecorder::recordCount() const
+{
+  return mCount;
+}
+
+bool ProtocolRecorder::dump(QIODevice* device) const
+{
+  uchar version[2];
+  qToLittleEndian<quint16>(formatVersion, version);
+  if (device->write(magic(), 6) != 6
+      || device->write(reinterpret_cast<const char*>(version), 2) != 2)
+    {
+      return false;
+    }
+
+  qint64 firstTimestamp = -1;
+  QByteArray payload;
+  int offset = mBegin;
+  for (int i = 0; i < mCount; ++i)
+    {
+      Header header;
+      read(offset, reinterpret_cast<char*>(&header), sizeof(header));
+      offset = (offset + sizeof(header)) % mRing.size();
+      payload.resize(header.size);
+      read(offset, payload.data(), header.size);
+      offset = (offset + header.size) % mRing.size();
+
+      if (firstTimestamp < 0)
+        {
+          firstTimestamp = header.timestampUs;
+        }
+
+      uchar recordHeader[13];
+      qToLittleEndian<quint64>(header.timestampUs - firstTimestamp,
+                               recordHeader);
+      recordHeader[8] = header.direction;
+      qToLittleEndian<quint32>(header.size, recordHeader + 9);
+      if (device->write(reinterpret_cast<const char*>(recordHeader),
+                        sizeof(recordHeader)) != sizeof(recordHeader)
+          || device->write(payload) != payload.size())
+        {
+          return false;
+        }
+    }
+  return true;
+}
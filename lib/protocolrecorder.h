@@ -0,0 +1,78 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+
+class QIODevice;
+
+// Keeps the most recent framed requests and replies exchanged with the
+// daemon in a fixed-size ring buffer.  Recording copies the frame and a
+// small header; nothing is allocated or converted.
+//
+// A dump starts with the 6 byte magic "CMKREC" followed by a 16 bit format
+// version, then one record per frame, oldest first:
+//
+//   quint64 timestamp in microseconds since the first dumped record
+//   quint8  direction (0 = request, 1 = reply)
+//   quint32 payload size
+//   payload bytes (the frame contents without the magic markers)
+//
+// All integers are little endian.
+class ProtocolRecorder
+{
+public:
+  enum Direction {
+    Request,
+    Reply
+  };
+
+  explicit ProtocolRecorder(int capacity = 8 * 1024 * 1024);
+
+  void record(Direction direction, const char* data, int size);
+  void clear();
+
+  int recordCount() const;
+
+  bool dump(QIODevice* device) const;
+
+  static const char* magic();
+  static const quint16 formatVersion = 1;
+
+private:
+  struct Header
+  {
+    qint64 timestampUs;
+    quint32 size;
+    quint8 direction;
+  };
+
+  void write(int offset, const char* data, int size);
+  void read(int offset, char* data, int size) const;
+  void dropOldest();
+
+private:
+  QByteArray mRing;
+  int mBegin = 0;
+  int mUsed = 0;
+  int mCount = 0;
+  QElapsedTimer mClock;
+};
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "protocolreplay.h"
+
+#include "cmakeclient.h"
+#include "protocolrecorder.h"
+
+#include <QIODevice>
+#include <QTimer>
+#include <QtEndian>
+
+ProtocolReplay::ProtocolReplay(QObject* parent)
+  : QObject(parent)
+{
+  mTimer = new QTimer(this);
+  mTimer->setSingleShot(true);
+  connect(mTimer, &QTimer::timeout, this, &ProtocolReplay::feedDue);
+}
+
+bool ProtocolReplay::load(QIODevice* device)
+{
+  mReplies.clear();
+
+  auto head = device->read(8);
+  if (head.size() != 8 || !head.startsWith(ProtocolRecorder::magic())
+      || qFromLittleEndian<quint16>(
+           reinterpret_cast<const uchar*>(head.constData() + 6))
+         != ProtocolRecorder::formatVersion)
+    {
+      return false;
+    }
+
+  Q_FOREVER {
+    auto recordHeader = device->read(13);
+    if (recordHeader.isEmpty())
+      {
+        return true;
+      }
+    if (recordHeader.size() != 13)
+      {
+        return false;
+      }
+    auto data = reinterpret_cast<const uchar*>(recordHeader.constData());
+    auto direction = data[8];
+    auto size = qFromLittleEndian<quint32>(data + 9);
+
+    Reply reply;
+    reply.timestampUs = qFromLittleEndian<quint64>(data);
+    reply.payload = device->read(size);
+    if (reply.payload.size() != int(size))
+      {
+        return false;
+      }
+    if (direction == ProtocolRecorder::Reply)
+      {
+        mReplies.push_back(reply);
+      }
+  }
+}
+
+int ProtocolReplay::replyCount() const
+{
+  return mReplies.size();
+}
+
+void ProtocolReplay::start(CMakeClient* client, Speed speed)
+{
+  mClient = client;
+  mSpeed = speed;
+  mNext = 0;
+  mClock.start();
+  feedDue();
+}
+
+void ProtocolReplay::feedDue()
+{
+  qint64 base = mReplies.isEmpty() ? 0 : mReplies.first().timestampUs;
+  while (mNext < mReplies.size())
+    {
+      auto const& reply = mReplies.at(mNext);
+      qint64 dueInUs = reply.timestampUs - base - mClock.nsecsElapsed() / 1000;
+      if (mSpeed == OriginalSpeed && dueInUs > 0)
+        {
+          mTimer->start(int(qMax<qint64>(dueInUs / 1000, 1)));
+          return;
+        }
+      ++mNext;
+      mClient->replayReply(reply.payload);
+      if (mSpeed == MaximumSpeed && mNext < mReplies.size())
+        {
+          // Let the answers to this reply be delivered, and any requests
+          // they lead to be made, before the next reply.
+          mTimer->start(0);
+          return;
+        }
+    }
+  Q_EMIT finished();
+}
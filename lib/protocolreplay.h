@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+class CMakeClient;
+class QIODevice;
+class QTimer;
+
+// Feeds the replies of a ProtocolRecorder dump back into a CMakeClient
+// which has been started with CMakeClient::startOffline().  At
+// MaximumSpeed one reply is fed per pass of the event loop, so that
+// futures answered by a reply are seen before the next one.
+class ProtocolReplay : public QObject
+{
+  Q_OBJECT
+public:
+  enum Speed {
+    OriginalSpeed,
+    MaximumSpeed
+  };
+
+  ProtocolReplay(QObject* parent = 0);
+
+  bool load(QIODevice* device);
+
+  int replyCount() const;
+
+  void start(CMakeClient* client, Speed speed);
+
+Q_SIGNALS:
+  void finished();
+
+private:
+  void feedDue();
+
+private:
+  struct Reply
+  {
+    qint64 timestampUs;
+    QByteArray payload;
+  };
+
+  QVector<Reply> mReplies;
+  CMakeClient* mClient = nullptr;
+  Speed mSpeed = OriginalSpeed;
+  int mNext = 0;
+  QElapsedTimer mClock;
+  QTimer* mTimer;
+};
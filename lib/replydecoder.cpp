@@ -0,0 +1,649 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "replydecoder.h"
+
+#include <algorithm>
+
+namespace
+{
+
+struct TokenTypeEntry
+{
+  const char* name;
+  TokenType type;
+  int lengthAdjust;
+};
+
+// Perfect hash over the token type names sent by the daemon: every name
+// lands in a distinct slot of (length + first character) % 32.  The table
+// is laid out by slot and checked at compile time.
+constexpr uint tokenTypeSlot(const char* s, uint len)
+{
+  return (len + quint8(s[0])) & 31;
+}
+
+constexpr uint constLength(const char* s)
+{
+  return *s ? 1 + constLength(s + 1) : 0;
+}
+
+#define NO_TOKEN { nullptr, Identifier, 0 }
+
+constexpr TokenTypeEntry tokenTypeTable[32] = {
+  { "quoted argument", QuotedArgument, 2 },      // 0
+  { "user_command", UserCommand, 0 },            // 1
+  NO_TOKEN, NO_TOKEN, NO_TOKEN, NO_TOKEN,
+  { "unquoted argument", Identifier, 0 },        // 6
+  NO_TOKEN, NO_TOKEN, NO_TOKEN,
+  { "command", Command, 0 },                     // 10
+  NO_TOKEN, NO_TOKEN, NO_TOKEN, NO_TOKEN,
+  NO_TOKEN, NO_TOKEN, NO_TOKEN, NO_TOKEN,
+  { "identifier", Identifier, 0 },               // 19
+  NO_TOKEN, NO_TOKEN,
+  { "left paren", OpenParen, 0 },                // 22
+  NO_TOKEN, NO_TOKEN, NO_TOKEN, NO_TOKEN,
+  NO_TOKEN, NO_TOKEN,
+  { "right paren", ClosedParen, 0 },             // 29
+  NO_TOKEN, NO_TOKEN
+};
+
+#undef NO_TOKEN
+
+constexpr bool tokenTypeTableConsistent(uint i = 0)
+{
+  return i == 32
+      || ((!tokenTypeTable[i].name
+           || tokenTypeSlot(tokenTypeTable[i].name,
+                            constLength(tokenTypeTable[i].name)) == i)
+          && tokenTypeTableConsistent(i + 1));
+}
+
+static_assert(tokenTypeTableConsistent(),
+              "token type names must sit in their hash slot");
+
+// Takes the name as a QString, or as the raw text of an unescaped JSON
+// string.
+template <typename Str>
+const TokenTypeEntry* lookupTokenType(const Str& type, uint first)
+{
+  if (type.size() == 0)
+    {
+      return nullptr;
+    }
+  auto const& entry = tokenTypeTable[(type.size() + first) & 31];
+  if (!entry.name || type != QLatin1String(entry.name))
+    {
+      return nullptr;
+    }
+  return &entry;
+}
+
+void applyTokenType(Fragment& fragment, const TokenTypeEntry* entry)
+{
+  fragment.tokenType = Identifier;
+  if (entry)
+    {
+      fragment.tokenType = entry->type;
+      fragment.length += entry->lengthAdjust;
+    }
+}
+
+}
+
+void setTokenType(Fragment& fragment, const QString& type)
+{
+  applyTokenType(fragment, lookupTokenType(type, type.isEmpty()
+                                           ? 0 : type.at(0).unicode()));
+}
+
+void ReplyDecoder::reset()
+{
+  *this = ReplyDecoder();
+}
+
+ReplyDecoder::Kind ReplyDecoder::kind() const
+{
+  return mKind;
+}
+
+bool ReplyDecoder::isComplete() const
+{
+  return mState == Done;
+}
+
+const QStringList& ReplyDecoder::configs() const
+{
+  return mConfigs;
+}
+
+const QVector<CMakeTarget>& ReplyDecoder::targets() const
+{
+  return mTargets;
+}
+
+const QMap<int, int>& ReplyDecoder::unreachable() const
+{
+  return mUnreachable;
+}
+
+const QVector<Fragment>& ReplyDecoder::fragments() const
+{
+  return mFragments;
+}
+
+bool ReplyDecoder::feed(const char* data, int size)
+{
+  mReader.setData(data, size);
+  while (mState != Done && mKind != Other)
+    {
+      // Each step either completes or is taken again from the start once
+      // more data has arrived, so a target or token is never half decoded.
+      auto position = mReader.position();
+      auto status = step();
+      if (status == Waiting)
+        {
+          mReader.setPosition(position);
+          return true;
+        }
+      if (status == Failed)
+        {
+          mKind = Other;
+          return false;
+        }
+    }
+  return true;
+}
+
+ReplyDecoder::Status ReplyDecoder::enter(JsonPullReader::Token begin,
+                                         State state)
+{
+  auto token = mReader.next();
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  if (token != begin)
+    {
+      return Failed;
+    }
+  mState = state;
+  return Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::skip()
+{
+  auto token = mReader.skipValue(mReader.next());
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  return token == JsonPullReader::Invalid ? Failed : Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::step()
+{
+  if (mState == Start)
+    {
+      return enter(JsonPullReader::BeginObject, TopKey);
+    }
+
+  auto token = mReader.next();
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+
+  switch (mState)
+    {
+    case TopKey:
+      if (token == JsonPullReader::EndObject)
+        {
+          mState = Done;
+          return Advanced;
+        }
+      if (token != JsonPullReader::String)
+        {
+          return Failed;
+        }
+      if (mKind == Undetermined)
+        {
+          Kind kind = mReader.stringEquals("buildsystem") ? Buildsystem
+                    : mReader.stringEquals("parsed") ? Parsed : Other;
+          if (kind == Other)
+            {
+              mKind = Other;
+              return Advanced;
+            }
+          auto status = enter(JsonPullReader::BeginObject,
+                              kind == Buildsystem ? BuildsystemKey : ParsedKey);
+          if (status == Advanced)
+            {
+              mKind = kind;
+            }
+          return status;
+        }
+      return skip();
+
+    case BuildsystemKey:
+      if (token == JsonPullReader::EndObject)
+        {
+          mState = TopKey;
+          return Advanced;
+        }
+      if (token != JsonPullReader::String)
+        {
+          return Failed;
+        }
+      if (mReader.stringEquals("configs"))
+        {
+          return enter(JsonPullReader::BeginArray, Configs);
+        }
+      if (mReader.stringEquals("targets"))
+        {
+          return enter(JsonPullReader::BeginArray, Targets);
+        }
+      return skip();
+
+    case Configs:
+      if (token == JsonPullReader::EndArray)
+        {
+          mState = BuildsystemKey;
+          return Advanced;
+        }
+      if (token != JsonPullReader::String)
+        {
+          return Failed;
+        }
+      mConfigs.append(mReader.string());
+      return Advanced;
+
+    case Targets:
+      {
+        if (token == JsonPullReader::EndArray)
+          {
+            mState = BuildsystemKey;
+            return Advanced;
+          }
+        if (token != JsonPullReader::BeginObject)
+          {
+            return Failed;
+          }
+        CMakeTarget target;
+        auto status = readTarget(target);
+        if (status == Advanced)
+          {
+            mTargets.append(target);
+          }
+        return status;
+      }
+
+    case ParsedKey:
+      if (token == JsonPullReader::EndObject)
+        {
+          mState = TopKey;
+          return Advanced;
+        }
+      if (token != JsonPullReader::String)
+        {
+          return Failed;
+        }
+      if (mReader.stringEquals("tokens"))
+        {
+          return enter(JsonPullReader::BeginArray, Tokens);
+        }
+      if (mReader.stringEquals("unreachable"))
+        {
+          return enter(JsonPullReader::BeginArray, Unreachable);
+        }
+      return skip();
+
+    case Tokens:
+      {
+        if (token == JsonPullReader::EndArray)
+          {
+            mState = ParsedKey;
+            return Advanced;
+          }
+        if (token != JsonPullReader::BeginObject)
+          {
+            return Failed;
+          }
+        Fragment fragment;
+        auto status = readFragment(fragment);
+        if (status == Advanced)
+          {
+            mFragments.append(fragment);
+          }
+        return status;
+      }
+
+    case Unreachable:
+      {
+        if (token == JsonPullReader::EndArray)
+          {
+            mState = ParsedKey;
+            return Advanced;
+          }
+        if (token != JsonPullReader::BeginObject)
+          {
+            return Failed;
+          }
+        int begin = 0;
+        int end = 0;
+        auto status = readRange(begin, end);
+        if (status == Advanced)
+          {
+            mUnreachable[begin] = end;
+          }
+        return status;
+      }
+
+    default:
+      return Failed;
+    }
+}
+
+ReplyDecoder::Status ReplyDecoder::readString(QString& str)
+{
+  auto token = mReader.next();
+  if (token == JsonPullReader::String)
+    {
+      str = mReader.string();
+      return Advanced;
+    }
+  // Anything else reads as an empty string, as QJsonValue::toString() has
+  // it.
+  str.clear();
+  token = mReader.skipValue(token);
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  return token == JsonPullReader::Invalid ? Failed : Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::readInt(int& number)
+{
+  auto token = mReader.next();
+  if (token == JsonPullReader::Number)
+    {
+      number = mReader.toInt();
+      return Advanced;
+    }
+  number = 0;
+  token = mReader.skipValue(token);
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  return token == JsonPullReader::Invalid ? Failed : Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::readStringList(QStringList& list)
+{
+  auto token = mReader.next();
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  if (token != JsonPullReader::BeginArray)
+    {
+      return Failed;
+    }
+  Q_FOREVER {
+    token = mReader.next();
+    switch (token)
+      {
+      case JsonPullReader::NeedData:
+        return Waiting;
+      case JsonPullReader::EndArray:
+        return Advanced;
+      case JsonPullReader::String:
+        list.append(mReader.string());
+        break;
+      default:
+        return Failed;
+      }
+  }
+}
+
+ReplyDecoder::Status ReplyDecoder::readBacktrace(
+    QVector<QPair<QString, int> >& backtrace)
+{
+  auto token = mReader.next();
+  if (token == JsonPullReader::NeedData)
+    {
+      return Waiting;
+    }
+  if (token != JsonPullReader::BeginArray)
+    {
+      return Failed;
+    }
+  Q_FOREVER {
+    token = mReader.next();
+    if (token == JsonPullReader::NeedData)
+      {
+        return Waiting;
+      }
+    if (token == JsonPullReader::EndArray)
+      {
+        return Advanced;
+      }
+    if (token != JsonPullReader::BeginObject)
+      {
+        return Failed;
+      }
+    QPair<QString, int> frame(QString(), 0);
+    Q_FOREVER {
+      token = mReader.next();
+      if (token == JsonPullReader::NeedData)
+        {
+          return Waiting;
+        }
+      if (token == JsonPullReader::EndObject)
+        {
+          break;
+        }
+      if (token != JsonPullReader::String)
+        {
+          return Failed;
+        }
+      Status status;
+      if (mReader.stringEquals("path"))
+        {
+          status = readString(frame.first);
+        }
+      else if (mReader.stringEquals("line"))
+        {
+          status = readInt(frame.second);
+        }
+      else
+        {
+          status = skip();
+        }
+      if (status != Advanced)
+        {
+          return status;
+        }
+    }
+    backtrace.append(frame);
+  }
+}
+
+ReplyDecoder::Status ReplyDecoder::readTarget(CMakeTarget& target)
+{
+  target.Type = CMakeTarget::typeFromString(QString());
+  target.Line = 0;
+  Q_FOREVER {
+    auto token = mReader.next();
+    if (token == JsonPullReader::NeedData)
+      {
+        return Waiting;
+      }
+    if (token == JsonPullReader::EndObject)
+      {
+        break;
+      }
+    if (token != JsonPullReader::String)
+      {
+        return Failed;
+      }
+    Status status;
+    if (mReader.stringEquals("name"))
+      {
+        status = readString(target.Name);
+      }
+    else if (mReader.stringEquals("projectName"))
+      {
+        status = readString(target.ProjectName);
+      }
+    else if (mReader.stringEquals("type"))
+      {
+        QString type;
+        status = readString(type);
+        target.Type = CMakeTarget::typeFromString(type);
+      }
+    else if (mReader.stringEquals("backtrace"))
+      {
+        status = readBacktrace(target.Backtrace);
+      }
+    else if (mReader.stringEquals("dependencies"))
+      {
+        status = readStringList(target.Dependencies);
+      }
+    else
+      {
+        status = skip();
+      }
+    if (status != Advanced)
+      {
+        return status;
+      }
+  }
+  std::reverse(target.Backtrace.begin(), target.Backtrace.end());
+  return Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::readFragment(Fragment& fragment)
+{
+  fragment.line = 0;
+  fragment.column = 0;
+  fragment.length = 0;
+  const TokenTypeEntry* type = nullptr;
+  Q_FOREVER {
+    auto token = mReader.next();
+    if (token == JsonPullReader::NeedData)
+      {
+        return Waiting;
+      }
+    if (token == JsonPullReader::EndObject)
+      {
+        break;
+      }
+    if (token != JsonPullReader::String)
+      {
+        return Failed;
+      }
+    Status status;
+    if (mReader.stringEquals("line"))
+      {
+        status = readInt(fragment.line);
+      }
+    else if (mReader.stringEquals("column"))
+      {
+        status = readInt(fragment.column);
+      }
+    else if (mReader.stringEquals("length"))
+      {
+        status = readInt(fragment.length);
+      }
+    else if (mReader.stringEquals("type"))
+      {
+        token = mReader.next();
+        if (token == JsonPullReader::NeedData)
+          {
+            return Waiting;
+          }
+        if (token != JsonPullReader::String)
+          {
+            return Failed;
+          }
+        if (mReader.isEscaped())
+          {
+            auto name = mReader.string();
+            type = lookupTokenType(name, name.isEmpty()
+                                   ? 0 : name.at(0).unicode());
+          }
+        else
+          {
+            auto name = mReader.rawString();
+            type = lookupTokenType(name, name.size() ? uchar(name.data()[0]) : 0);
+          }
+        status = Advanced;
+      }
+    else
+      {
+        status = skip();
+      }
+    if (status != Advanced)
+      {
+        return status;
+      }
+  }
+  // The length is adjusted once it is known, whichever member came first.
+  applyTokenType(fragment, type);
+  return Advanced;
+}
+
+ReplyDecoder::Status ReplyDecoder::readRange(int& begin, int& end)
+{
+  Q_FOREVER {
+    auto token = mReader.next();
+    if (token == JsonPullReader::NeedData)
+      {
+        return Waiting;
+      }
+    if (token == JsonPullReader::EndObject)
+      {
+        return Advanced;
+      }
+    if (token != JsonPullReader::String)
+      {
+        return Failed;
+      }
+    Status status;
+    if (mReader.stringEquals("begin"))
+      {
+        status = readInt(begin);
+      }
+    else if (mReader.stringEquals("end"))
+      {
+        status = readInt(end);
+      }
+    else
+      {
+        status = skip();
+      }
+    if (status != Advanced)
+      {
+        return status;
+      }
+  }
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include "cmakeclient.h"
+#include "jsonpullreader.h"
+
+// Decodes buildsystem and parsed replies straight from their JSON text
+// into targets and fragments, without a QJsonDocument in between.  It can
+// be fed a reply as it arrives: whatever has been decoded so far is
+// available while the rest is still being received.
+//
+// Other replies are reported as such once their first member has been
+// seen, and are left to the QJsonDocument path.
+class ReplyDecoder
+{
+public:
+  enum Kind {
+    Undetermined,
+    Buildsystem,
+    Parsed,
+    Other
+  };
+
+  void reset();
+
+  // Decodes what it can of a reply of which the first size bytes are at
+  // data.  The bytes must be the same as before on each call, with more
+  // of them.  Returns false if the reply is malformed.
+  bool feed(const char* data, int size);
+
+  Kind kind() const;
+  bool isComplete() const;
+
+  const QStringList& configs() const;
+  const QVector<CMakeTarget>& targets() const;
+  const QMap<int, int>& unreachable() const;
+  const QVector<Fragment>& fragments() const;
+
+private:
+  enum State {
+    Start,
+    TopKey,
+    BuildsystemKey,
+    Configs,
+    Targets,
+    ParsedKey,
+    Tokens,
+    Unreachable,
+    Done
+  };
+
+  enum Status {
+    Advanced,
+    Waiting,
+    Failed
+  };
+
+  Status step();
+  Status enter(JsonPullReader::Token begin, State state);
+  Status skip();
+  Status readString(QString& str);
+  Status readInt(int& number);
+  Status readStringList(QStringList& list);
+  Status readBacktrace(QVector<QPair<QString, int> >& backtrace);
+  Status readTarget(CMakeTarget& target);
+  Status readFragment(Fragment& fragment);
+  Status readRange(int& begin, int& end);
+
+private:
+  JsonPullReader mReader;
+  State mState = Start;
+  Kind mKind = Undetermined;
+  QStringList mConfigs;
+  QVector<CMakeTarget> mTargets;
+  QMap<int, int> mUnreachable;
+  QVector<Fragment> mFragments;
+};
+
+// Sets the type of a parse token from the name the daemon gives it, and
+// widens quoted arguments to cover their quotes.
+void setTokenType(Fragment& fragment, const QString& type);
@@ -0,0 +1,143 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "requeststats.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+qint64 RequestTypeStats::latencyPercentileUs(double fraction) const
+{
+  quint64 wanted = quint64(replies * fraction + 0.5);
+  quint64 seen = 0;
+  for (int i = 0; i < NumBuckets; ++i)
+    {
+      seen += latencyBuckets[i];
+      if (seen && seen >= wanted)
+        {
+          return qint64(1) << i;
+        }
+    }
+  return 0;
+}
+
+void RequestStats::recordRequest(const QString& type, qint64 bytes,
+                                 int queueDepth)
+{
+  auto& stats = mTypes[type];
+  ++stats.requests;
+  stats.bytesSent += bytes;
+  stats.totalQueueDepth += queueDepth;
+  stats.maxQueueDepth = qMax(stats.maxQueueDepth, queueDepth);
+}
+
+void RequestStats::recordReply(const QString& type, qint64 latencyUs,
+                               qint64 bytes, qint64 parseUs, qint64 handlerUs)
+{
+  auto& stats = mTypes[type];
+  ++stats.replies;
+  stats.bytesReceived += bytes;
+  stats.totalLatencyUs += latencyUs;
+  stats.maxLatencyUs = qMax(stats.maxLatencyUs, latencyUs);
+  stats.totalParseUs += parseUs;
+  stats.totalHandlerUs += handlerUs;
+
+  int bucket = 0;
+  while (bucket < RequestTypeStats::NumBuckets - 1
+         && (qint64(1) << bucket) <= latencyUs)
+    {
+      ++bucket;
+    }
+  ++stats.latencyBuckets[bucket];
+}
+
+void RequestStats::recordSuperseded(const QString& type)
+{
+  ++mTypes[type].superseded;
+}
+
+const QMap<QString, RequestTypeStats>& RequestStats::types() const
+{
+  return mTypes;
+}
+
+void RequestStats::clear()
+{
+  mTypes.clear();
+}
+
+QByteArray RequestStats::toJson() const
+{
+  QJsonArray types;
+  for (auto it = mTypes.constBegin(); it != mTypes.constEnd(); ++it)
+    {
+      auto const& stats = it.value();
+      QJsonObject obj;
+      obj["type"] = it.key();
+      obj["requests"] = double(stats.requests);
+      obj["replies"] = double(stats.replies);
+      obj["superseded"] = double(stats.superseded);
+      obj["bytes_sent"] = double(stats.bytesSent);
+      obj["bytes_received"] = double(stats.bytesReceived);
+      obj["total_latency_us"] = double(stats.totalLatencyUs);
+      obj["max_latency_us"] = double(stats.maxLatencyUs);
+      obj["total_parse_us"] = double(stats.totalParseUs);
+      obj["total_handler_us"] = double(stats.totalHandlerUs);
+      obj["total_queue_depth"] = double(stats.totalQueueDepth);
+      obj["max_queue_depth"] = stats.maxQueueDepth;
+      QJsonArray buckets;
+      for (auto count : stats.latencyBuckets)
+        {
+          buckets.append(double(count));
+        }
+      obj["latency_buckets_log2_us"] = buckets;
+      types.append(obj);
+    }
+  return QJsonDocument(types).toJson();
+}
+
+QByteArray RequestStats::toCsv() const
+{
+  QByteArray csv = "type,requests,replies,bytes_sent,bytes_received,"
+                   "mean_latency_us,p50_latency_us,p95_latency_us,"
+                   "max_latency_us,mean_parse_us,mean_handler_us,"
+                   "mean_queue_depth,max_queue_depth,superseded\n";
+  for (auto it = mTypes.constBegin(); it != mTypes.constEnd(); ++it)
+    {
+      auto const& stats = it.value();
+      auto replies = qMax<quint64>(stats.replies, 1);
+      auto requests = qMax<quint64>(stats.requests, 1);
+      csv += it.key().toUtf8() + ','
+          + QByteArray::number(stats.requests) + ','
+          + QByteArray::number(stats.replies) + ','
+          + QByteArray::number(stats.bytesSent) + ','
+          + QByteArray::number(stats.bytesReceived) + ','
+          + QByteArray::number(stats.totalLatencyUs / replies) + ','
+          + QByteArray::number(stats.latencyPercentileUs(0.5)) + ','
+          + QByteArray::number(stats.latencyPercentileUs(0.95)) + ','
+          + QByteArray::number(stats.maxLatencyUs) + ','
+          + QByteArray::number(stats.totalParseUs / replies) + ','
+          + QByteArray::number(stats.totalHandlerUs / replies) + ','
+          + QByteArray::number(double(stats.totalQueueDepth) / requests) + ','
+          + QByteArray::number(stats.maxQueueDepth) + ','
+          + QByteArray::number(stats.superseded) + '\n';
+    }
+  return csv;
+}
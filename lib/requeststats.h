@@ -0,0 +1,66 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+struct RequestTypeStats
+{
+  // Round trip latencies in power-of-two buckets of microseconds; bucket i
+  // counts latencies below 2^i us.
+  enum { NumBuckets = 32 };
+
+  quint64 requests = 0;
+  quint64 replies = 0;
+  // Requests replaced while queued by a newer one; never answered.
+  quint64 superseded = 0;
+  quint64 bytesSent = 0;
+  quint64 bytesReceived = 0;
+  qint64 totalLatencyUs = 0;
+  qint64 maxLatencyUs = 0;
+  qint64 totalParseUs = 0;
+  qint64 totalHandlerUs = 0;
+  quint64 totalQueueDepth = 0;
+  int maxQueueDepth = 0;
+  quint64 latencyBuckets[NumBuckets] = {};
+
+  // Upper bound of the bucket holding the given fraction of replies.
+  qint64 latencyPercentileUs(double fraction) const;
+};
+
+class RequestStats
+{
+public:
+  void recordRequest(const QString& type, qint64 bytes, int queueDepth);
+  void recordReply(const QString& type, qint64 latencyUs, qint64 bytes,
+                   qint64 parseUs, qint64 handlerUs);
+  void recordSuperseded(const QString& type);
+
+  const QMap<QString, RequestTypeStats>& types() const;
+  void clear();
+
+  QByteArray toJson() const;
+  QByteArray toCsv() const;
+
+private:
+  QMap<QString, RequestTypeStats> mTypes;
+};
@@ -0,0 +1,125 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "resultsstore.h"
+
+quint32 ResultsStore::generation() const
+{
+  return mGeneration;
+}
+
+void ResultsStore::advance(quint32 generation)
+{
+  if (generation == mGeneration)
+    {
+      return;
+    }
+  mGeneration = generation;
+  mHasBuildsystem = false;
+  mBuildsystem = CMakeBuildsystem();
+  mTargetInfo.clear();
+  mParsed.clear();
+  mReplies.clear();
+}
+
+bool ResultsStore::accept(quint32 generation)
+{
+  // Generations only count up, wrapping around after 2^32 of them.
+  if (qint32(generation - mGeneration) < 0)
+    {
+      return false;
+    }
+  advance(generation);
+  return true;
+}
+
+bool ResultsStore::insertBuildsystem(quint32 generation,
+                                     const CMakeBuildsystem& buildsystem)
+{
+  if (!accept(generation))
+    {
+      return false;
+    }
+  mHasBuildsystem = true;
+  mBuildsystem = buildsystem;
+  return true;
+}
+
+bool ResultsStore::insertTargetInfo(quint32 generation,
+                                    const CMakeTargetInfo& info)
+{
+  if (!accept(generation))
+    {
+      return false;
+    }
+  mTargetInfo.insert(info);
+  return true;
+}
+
+bool ResultsStore::insertParsed(quint32 generation, const QString& filePath,
+                                const CMakeParseResult& parsed)
+{
+  if (!accept(generation))
+    {
+      return false;
+    }
+  mParsed.insert(filePath, parsed);
+  return true;
+}
+
+bool ResultsStore::insertReply(quint32 generation, const QByteArray& request,
+                               const QByteArray& reply)
+{
+  if (!accept(generation))
+    {
+      return false;
+    }
+  mReplies.insert(request, reply);
+  return true;
+}
+
+bool ResultsStore::hasBuildsystem() const
+{
+  return mHasBuildsystem;
+}
+
+CMakeBuildsystem ResultsStore::buildsystem() const
+{
+  return mBuildsystem;
+}
+
+const TargetInfoStore& ResultsStore::targetInfo() const
+{
+  return mTargetInfo;
+}
+
+bool ResultsStore::containsParsed(const QString& filePath) const
+{
+  return mParsed.contains(filePath);
+}
+
+CMakeParseResult ResultsStore::parsed(const QString& filePath) const
+{
+  return mParsed.value(filePath);
+}
+
+QByteArray ResultsStore::reply(const QByteArray& request) const
+{
+  return mReplies.value(request);
+}
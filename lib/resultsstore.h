@@ -0,0 +1,62 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include "targetinfostore.h"
+
+// The decoded replies of the current configure generation: the
+// buildsystem, the target_info of every target and config, the tokens of
+// every parsed file, and the raw replies which may be answered again from
+// cache.  Every result is stamped with the generation of the request it
+// answers.  Advancing to a new generation drops what the older one held,
+// and a result stamped with an older generation is refused.
+class ResultsStore
+{
+public:
+  quint32 generation() const;
+  void advance(quint32 generation);
+
+  bool insertBuildsystem(quint32 generation,
+                         const CMakeBuildsystem& buildsystem);
+  bool insertTargetInfo(quint32 generation, const CMakeTargetInfo& info);
+  bool insertParsed(quint32 generation, const QString& filePath,
+                    const CMakeParseResult& parsed);
+  bool insertReply(quint32 generation, const QByteArray& request,
+                   const QByteArray& reply);
+
+  bool hasBuildsystem() const;
+  CMakeBuildsystem buildsystem() const;
+  const TargetInfoStore& targetInfo() const;
+  bool containsParsed(const QString& filePath) const;
+  CMakeParseResult parsed(const QString& filePath) const;
+  // The reply to the request, or a null array if there is none.
+  QByteArray reply(const QByteArray& request) const;
+
+private:
+  bool accept(quint32 generation);
+
+private:
+  quint32 mGeneration = 0;
+  bool mHasBuildsystem = false;
+  CMakeBuildsystem mBuildsystem;
+  TargetInfoStore mTargetInfo;
+  QHash<QString, CMakeParseResult> mParsed;
+  QHash<QByteArray, QByteArray> mReplies;
+};
@@ -0,0 +1,156 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "statswidget.h"
+
+#include "cmakeclient.h"
+
+#include <QFile>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+namespace {
+
+QString formatMs(qint64 us)
+{
+  return QString::number(us / 1000.0, 'f', 2);
+}
+
+QString formatBytes(quint64 bytes)
+{
+  if (bytes >= 1024 * 1024)
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MiB";
+  if (bytes >= 1024)
+    return QString::number(bytes / 1024.0, 'f', 1) + " KiB";
+  return QString::number(bytes) + " B";
+}
+
+}
+
+StatsWidget::StatsWidget(CMakeClient* client, QWidget* parent)
+  : QWidget(parent), mClient(client)
+{
+  QVBoxLayout *layout = new QVBoxLayout(this);
+
+  mQueueLabel = new QLabel;
+  layout->addWidget(mQueueLabel);
+
+  mTable = new QTreeWidget;
+  mTable->setRootIsDecorated(false);
+  mTable->setHeaderLabels({"Request", "Count", "Mean ms", "p50 ms",
+                           "p95 ms", "Max ms", "Sent", "Received",
+                           "Parse ms", "Handler ms", "Queue depth",
+                           "Superseded"});
+  layout->addWidget(mTable);
+
+  QHBoxLayout *buttons = new QHBoxLayout;
+  auto resetButton = new QPushButton("Reset");
+  auto jsonButton = new QPushButton("Export JSON...");
+  auto csvButton = new QPushButton("Export CSV...");
+  buttons->addWidget(resetButton);
+  buttons->addStretch();
+  buttons->addWidget(jsonButton);
+  buttons->addWidget(csvButton);
+  layout->addLayout(buttons);
+
+  connect(resetButton, &QPushButton::clicked, [this] {
+      mClient->clearStats();
+      refresh();
+    });
+  connect(jsonButton, &QPushButton::clicked, [this] {
+      exportStats(false);
+    });
+  connect(csvButton, &QPushButton::clicked, [this] {
+      exportStats(true);
+    });
+
+  mRefreshTimer = new QTimer(this);
+  mRefreshTimer->setInterval(1000);
+  connect(mRefreshTimer, &QTimer::timeout, this, &StatsWidget::refresh);
+}
+
+void StatsWidget::showEvent(QShowEvent* event)
+{
+  QWidget::showEvent(event);
+  refresh();
+  mRefreshTimer->start();
+}
+
+void StatsWidget::hideEvent(QHideEvent* event)
+{
+  mRefreshTimer->stop();
+  QWidget::hideEvent(event);
+}
+
+void StatsWidget::refresh()
+{
+  mQueueLabel->setText(QString("Requests awaiting a reply: %1")
+                       .arg(mClient->pendingRequests()));
+
+  mTable->clear();
+  auto const& types = mClient->stats().types();
+  for (auto it = types.constBegin(); it != types.constEnd(); ++it)
+    {
+      auto const& stats = it.value();
+      auto replies = qMax<qint64>(stats.replies, 1);
+      auto requests = qMax<qint64>(stats.requests, 1);
+      mTable->addTopLevelItem(new QTreeWidgetItem(QStringList{
+          it.key(),
+          QString::number(stats.requests),
+          formatMs(stats.totalLatencyUs / replies),
+          formatMs(stats.latencyPercentileUs(0.5)),
+          formatMs(stats.latencyPercentileUs(0.95)),
+          formatMs(stats.maxLatencyUs),
+          formatBytes(stats.bytesSent),
+          formatBytes(stats.bytesReceived),
+          formatMs(stats.totalParseUs / replies),
+          formatMs(stats.totalHandlerUs / replies),
+          QString::number(double(stats.totalQueueDepth) / requests, 'f', 1)
+            + " / " + QString::number(stats.maxQueueDepth),
+          QString::number(stats.superseded)
+        }));
+    }
+  for (int i = 0; i < mTable->columnCount(); ++i)
+    {
+      mTable->resizeColumnToContents(i);
+    }
+}
+
+void StatsWidget::exportStats(bool csv)
+{
+  auto fileName = QFileDialog::getSaveFileName(
+        this, "Export Request Statistics", QString(),
+        csv ? "CSV (*.csv)" : "JSON (*.json)");
+  if (fileName.isEmpty())
+    {
+      return;
+    }
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+      return;
+    }
+  file.write(csv ? mClient->stats().toCsv() : mClient->stats().toJson());
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QWidget>
+
+class CMakeClient;
+class QLabel;
+class QTimer;
+class QTreeWidget;
+
+class StatsWidget : public QWidget
+{
+  Q_OBJECT
+public:
+  StatsWidget(CMakeClient* client, QWidget* parent = 0);
+
+private Q_SLOTS:
+  void refresh();
+  void exportStats(bool csv);
+
+protected:
+  void showEvent(QShowEvent* event) override;
+  void hideEvent(QHideEvent* event) override;
+
+private:
+  CMakeClient* mClient;
+  QTreeWidget* mTable;
+  QLabel* mQueueLabel;
+  QTimer* mRefreshTimer;
+};
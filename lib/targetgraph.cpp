@@ -0,0 +1,195 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "targetgraph.h"
+
+#include "cmakeclient.h"
+#include "tracing.h"
+
+void TargetGraph::clear()
+{
+  mNames.clear();
+  mIndices.clear();
+  mOffsets.clear();
+  mEdges.clear();
+  mWordsPerTarget = 0;
+  mDependents.clear();
+}
+
+void TargetGraph::build(const QVector<CMakeTarget>& targets)
+{
+  CMK_TRACE_SCOPE("graph", "build");
+  clear();
+
+  int count = targets.size();
+  for (int i = 0; i < count; ++i)
+    {
+      mNames.append(targets.at(i).Name);
+      mIndices.insert(targets.at(i).Name, i);
+    }
+
+  mOffsets.reserve(count + 1);
+  for (auto const& target : targets)
+    {
+      mOffsets.append(mEdges.size());
+      for (auto const& dep : target.Dependencies)
+        {
+          // Dependencies on imported or system libraries are not targets.
+          auto it = mIndices.constFind(dep);
+          if (it != mIndices.constEnd())
+            {
+              mEdges.append(it.value());
+            }
+        }
+    }
+  mOffsets.append(mEdges.size());
+
+  // Visit dependencies before their dependents, so that a reversed walk
+  // sees every dependent of a target before the target itself.
+  QVector<int> order;
+  order.reserve(count);
+  QVector<char> state(count, 0);
+  QVector<QPair<int, int> > stack;
+  for (int root = 0; root < count; ++root)
+    {
+      if (state.at(root))
+        {
+          continue;
+        }
+      stack.append(qMakePair(root, mOffsets.at(root)));
+      state[root] = 1;
+      while (!stack.isEmpty())
+        {
+          auto& top = stack.last();
+          if (top.second < mOffsets.at(top.first + 1))
+            {
+              auto next = mEdges.at(top.second++);
+              if (!state.at(next))
+                {
+                  state[next] = 1;
+                  stack.append(qMakePair(next, mOffsets.at(next)));
+                }
+              continue;
+            }
+          order.append(top.first);
+          stack.removeLast();
+        }
+    }
+
+  mWordsPerTarget = (count + 63) / 64;
+  mDependents.fill(0, count * mWordsPerTarget);
+
+  // Propagate along the reversed order.  Without cycles one pass settles
+  // everything and a second confirms it; link cycles among static
+  // libraries need a pass more per cycle.
+  bool changed;
+  do
+    {
+      changed = false;
+      for (int i = count - 1; i >= 0; --i)
+        {
+          int dependent = order.at(i);
+          auto dependentBits = mDependents.constData()
+              + dependent * mWordsPerTarget;
+          auto dependentWord = dependent / 64;
+          auto dependentMask = quint64(1) << (dependent % 64);
+          for (int e = mOffsets.at(dependent); e < mOffsets.at(dependent + 1); ++e)
+            {
+              auto bits = mDependents.data() + mEdges.at(e) * mWordsPerTarget;
+              quint64 added = dependentMask & ~bits[dependentWord];
+              bits[dependentWord] |= dependentMask;
+              for (int w = 0; w < mWordsPerTarget; ++w)
+                {
+                  added |= dependentBits[w] & ~bits[w];
+                  bits[w] |= dependentBits[w];
+                }
+              changed |= added != 0;
+            }
+        }
+    }
+  while (changed);
+}
+
+int TargetGraph::targetCount() const
+{
+  return mNames.size();
+}
+
+int TargetGraph::indexOf(const QString& name) const
+{
+  return mIndices.value(name, -1);
+}
+
+QString TargetGraph::name(int index) const
+{
+  return mNames.value(index);
+}
+
+QVector<int> TargetGraph::dependencies(int index) const
+{
+  return mEdges.mid(mOffsets.at(index),
+                    mOffsets.at(index + 1) - mOffsets.at(index));
+}
+
+const quint64* TargetGraph::dependentsBits(int index) const
+{
+  return mDependents.constData() + index * mWordsPerTarget;
+}
+
+QVector<int> TargetGraph::transitiveDependents(int index) const
+{
+  QVector<int> result;
+  auto bits = dependentsBits(index);
+  for (int w = 0; w < mWordsPerTarget; ++w)
+    {
+      auto word = bits[w];
+      while (word)
+        {
+          int bit = 0;
+          while (!(word & (quint64(1) << bit)))
+            {
+              ++bit;
+            }
+          word &= word - 1;
+          result.append(w * 64 + bit);
+        }
+    }
+  return result;
+}
+
+bool TargetGraph::dependsOn(int dependent, int dependency) const
+{
+  return dependentsBits(dependency)[dependent / 64]
+      & (quint64(1) << (dependent % 64));
+}
+
+QStringList TargetGraph::transitiveDependents(const QString& name) const
+{
+  QStringList names;
+  auto index = indexOf(name);
+  if (index < 0)
+    {
+      return names;
+    }
+  for (auto dependent : transitiveDependents(index))
+    {
+      names.append(mNames.at(dependent));
+    }
+  return names;
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+struct CMakeTarget;
+
+// The link dependencies between targets.  Edges are stored compactly by
+// target index, and for every target the set of targets which depend on
+// it, directly or not, is precomputed as a bitset so that impact queries
+// are a scan over a few words.
+class TargetGraph
+{
+public:
+  void build(const QVector<CMakeTarget>& targets);
+  void clear();
+
+  int targetCount() const;
+  // -1 for unknown names.
+  int indexOf(const QString& name) const;
+  QString name(int index) const;
+
+  QVector<int> dependencies(int index) const;
+  // Every target which needs rebuilding when the given one changes.
+  QVector<int> transitiveDependents(int index) const;
+  bool dependsOn(int dependent, int dependency) const;
+
+  QStringList transitiveDependents(const QString& name) const;
+
+private:
+  const quint64* dependentsBits(int index) const;
+
+private:
+  QStringList mNames;
+  QHash<QString, int> mIndices;
+  // Dependencies of target i are mEdges[mOffsets[i], mOffsets[i + 1]).
+  QVector<int> mOffsets;
+  QVector<int> mEdges;
+  int mWordsPerTarget = 0;
+  QVector<quint64> mDependents;
+};
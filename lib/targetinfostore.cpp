@@ -0,0 +1,147 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "targetinfostore.h"
+
+void TargetInfoStore::clear()
+{
+  mTargets.clear();
+}
+
+QStringList* TargetInfoStore::lists(CMakeTargetInfo& info, int index)
+{
+  switch (index)
+    {
+    case 0:
+      return &info.Sources;
+    case 1:
+      return &info.GeneratedSources;
+    case 2:
+      return &info.IncludeDirectories;
+    default:
+      return &info.CompileDefinitions;
+    }
+}
+
+TargetInfoStore::ListDelta TargetInfoStore::makeDelta(const QStringList& base,
+                                                      const QStringList& list)
+{
+  ListDelta delta;
+  int common = qMin(base.size(), list.size());
+  while (delta.keepFront < common
+         && base.at(delta.keepFront) == list.at(delta.keepFront))
+    {
+      ++delta.keepFront;
+    }
+  while (delta.keepBack < common - delta.keepFront
+         && base.at(base.size() - 1 - delta.keepBack)
+            == list.at(list.size() - 1 - delta.keepBack))
+    {
+      ++delta.keepBack;
+    }
+  delta.middle = list.mid(delta.keepFront,
+                          list.size() - delta.keepFront - delta.keepBack);
+  return delta;
+}
+
+QStringList TargetInfoStore::applyDelta(const QStringList& base,
+                                        const ListDelta& delta)
+{
+  return base.mid(0, delta.keepFront) + delta.middle
+      + base.mid(base.size() - delta.keepBack);
+}
+
+void TargetInfoStore::insert(const CMakeTargetInfo& info)
+{
+  auto it = mTargets.find(info.Name);
+  if (it == mTargets.end())
+    {
+      Entry entry;
+      entry.base = info;
+      mTargets.insert(info.Name, entry);
+      return;
+    }
+  if (it->base.Config == info.Config)
+    {
+      // The deltas were made against the old base; rebuild them.
+      QVector<CMakeTargetInfo> others;
+      for (auto d = it->deltas.constBegin(); d != it->deltas.constEnd(); ++d)
+        {
+          others.append(this->info(info.Name, d.key()));
+        }
+      it->base = info;
+      it->deltas.clear();
+      for (auto const& other : others)
+        {
+          insert(other);
+        }
+      return;
+    }
+
+  auto base = it->base;
+  auto copy = info;
+  ConfigDelta delta;
+  for (int i = 0; i < NumLists; ++i)
+    {
+      delta.lists[i] = makeDelta(*lists(base, i), *lists(copy, i));
+    }
+  it->deltas.insert(info.Config, delta);
+}
+
+bool TargetInfoStore::contains(const QString& targetName,
+                               const QString& config) const
+{
+  auto it = mTargets.constFind(targetName);
+  return it != mTargets.constEnd()
+      && (it->base.Config == config || it->deltas.contains(config));
+}
+
+CMakeTargetInfo TargetInfoStore::info(const QString& targetName,
+                                      const QString& config) const
+{
+  auto it = mTargets.constFind(targetName);
+  if (it == mTargets.constEnd())
+    {
+      return CMakeTargetInfo();
+    }
+  if (it->base.Config == config)
+    {
+      return it->base;
+    }
+  auto delta = it->deltas.constFind(config);
+  if (delta == it->deltas.constEnd())
+    {
+      return CMakeTargetInfo();
+    }
+
+  auto base = it->base;
+  CMakeTargetInfo result;
+  result.Name = targetName;
+  result.Config = config;
+  for (int i = 0; i < NumLists; ++i)
+    {
+      *lists(result, i) = applyDelta(*lists(base, i), delta->lists[i]);
+    }
+  return result;
+}
+
+QStringList TargetInfoStore::targetNames() const
+{
+  return mTargets.keys();
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include "cmakeclient.h"
+
+// The target_info of every target in every configuration.  The first
+// configuration received for a target is stored in full; the others only
+// as the span of each list which differs from it, so that Debug and
+// Release differing by a define cost a define.
+class TargetInfoStore
+{
+public:
+  void clear();
+
+  void insert(const CMakeTargetInfo& info);
+  bool contains(const QString& targetName, const QString& config) const;
+  CMakeTargetInfo info(const QString& targetName,
+                       const QString& config) const;
+
+  QStringList targetNames() const;
+
+private:
+  enum { NumLists = 4 };
+
+  // The list equals the base with base[keepFront, size - keepBack)
+  // replaced by middle.
+  struct ListDelta
+  {
+    int keepFront = 0;
+    int keepBack = 0;
+    QStringList middle;
+  };
+
+  struct ConfigDelta
+  {
+    ListDelta lists[NumLists];
+  };
+
+  struct Entry
+  {
+    CMakeTargetInfo base;
+    QHash<QString, ConfigDelta> deltas;
+  };
+
+  static QStringList* lists(CMakeTargetInfo& info, int index);
+  static ListDelta makeDelta(const QStringList& base, const QStringList& list);
+  static QStringList applyDelta(const QStringList& base,
+                                const ListDelta& delta);
+
+private:
+  QHash<QString, Entry> mTargets;
+};
@@ -0,0 +1,200 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "tracing.h"
+
+#include <QCoreApplication>
+#include <QIODevice>
+#include <QMutex>
+#include <QVector>
+
+#include <chrono>
+
+namespace {
+
+struct Event
+{
+  const char* category;
+  const char* name;
+  qint64 startUs;
+  qint64 durationUs;
+  char phase;
+};
+
+struct ThreadBuffer
+{
+  enum { Capacity = 1 << 16 };
+
+  quint64 threadId;
+  // Number of events appended since the buffer was last cleared, and the
+  // clear it has seen; only the owning thread writes them.
+  std::atomic<quint64> count;
+  std::atomic<quint64> epoch;
+  Event events[Capacity];
+};
+
+// Bumped by Tracing::clear(); each thread empties its own buffer when it
+// next appends, so that no other thread writes to it.
+std::atomic<quint64> gEpoch(0);
+
+QMutex gBuffersMutex;
+QVector<ThreadBuffer*> gBuffers;
+quint64 gNextThreadId = 1;
+
+thread_local ThreadBuffer* tlBuffer = nullptr;
+
+const auto gOrigin = std::chrono::steady_clock::now();
+
+ThreadBuffer* threadBuffer()
+{
+  if (!tlBuffer)
+    {
+      // Buffers outlive their threads so that their events can still be
+      // written out.
+      auto buffer = new ThreadBuffer;
+      buffer->count.store(0, std::memory_order_relaxed);
+      buffer->epoch.store(gEpoch.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      QMutexLocker lock(&gBuffersMutex);
+      buffer->threadId = gNextThreadId++;
+      gBuffers.push_back(buffer);
+      tlBuffer = buffer;
+    }
+  return tlBuffer;
+}
+
+void append(const char* category, const char* name,
+            qint64 startUs, qint64 durationUs, char phase)
+{
+  auto buffer = threadBuffer();
+  auto epoch = gEpoch.load(std::memory_order_relaxed);
+  if (buffer->epoch.load(std::memory_order_relaxed) != epoch)
+    {
+      buffer->count.store(0, std::memory_order_relaxed);
+      buffer->epoch.store(epoch, std::memory_order_release);
+    }
+  auto index = buffer->count.load(std::memory_order_relaxed);
+  // A reader which sees any of the slot being overwritten also sees the
+  // count that tells it so.
+  std::atomic_thread_fence(std::memory_order_release);
+  auto& event = buffer->events[index % ThreadBuffer::Capacity];
+  event.category = category;
+  event.name = name;
+  event.startUs = startUs;
+  event.durationUs = durationUs;
+  event.phase = phase;
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+}
+
+std::atomic<bool> Tracing::gEnabled(false);
+
+void Tracing::setEnabled(bool enabled)
+{
+  gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Tracing::nowUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - gOrigin).count();
+}
+
+void Tracing::recordSpan(const char* category, const char* name,
+                         qint64 startUs, qint64 durationUs)
+{
+  append(category, name, startUs, durationUs, 'X');
+}
+
+void Tracing::recordInstant(const char* category, const char* name)
+{
+  append(category, name, nowUs(), 0, 'i');
+}
+
+void Tracing::writeChromeTrace(QIODevice* device)
+{
+  auto pid = QByteArray::number(QCoreApplication::applicationPid());
+
+  device->write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+
+  QMutexLocker lock(&gBuffersMutex);
+  auto currentEpoch = gEpoch.load(std::memory_order_relaxed);
+  for (auto buffer : gBuffers)
+    {
+      auto epoch = buffer->epoch.load(std::memory_order_acquire);
+      if (epoch != currentEpoch)
+        {
+          // Cleared since its thread last appended.
+          continue;
+        }
+      auto count = buffer->count.load(std::memory_order_acquire);
+      quint64 begin = count > quint64(ThreadBuffer::Capacity)
+          ? count - ThreadBuffer::Capacity : 0;
+      auto tid = QByteArray::number(buffer->threadId);
+      for (auto i = begin; i < count; ++i)
+        {
+          // The owning thread keeps appending; drop an event whose slot it
+          // may have reused while the event was copied.
+          Event event = buffer->events[i % ThreadBuffer::Capacity];
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (buffer->epoch.load(std::memory_order_relaxed) != epoch)
+            {
+              break;
+            }
+          if (buffer->count.load(std::memory_order_relaxed)
+              >= i + ThreadBuffer::Capacity)
+            {
+              continue;
+            }
+          QByteArray json = first ? "\n{" : ",\n{";
+          first = false;
+          json += "\"cat\":\"";
+          json += event.category;
+          json += "\",\"name\":\"";
+          json += event.name;
+          json += "\",\"ph\":\"";
+          json += event.phase;
+          json += "\",\"ts\":";
+          json += QByteArray::number(event.startUs);
+          if (event.phase == 'X')
+            {
+              json += ",\"dur\":";
+              json += QByteArray::number(event.durationUs);
+            }
+          else
+            {
+              json += ",\"s\":\"t\"";
+            }
+          json += ",\"pid\":";
+          json += pid;
+          json += ",\"tid\":";
+          json += tid;
+          json += '}';
+          device->write(json);
+        }
+    }
+  device->write("\n]}\n");
+}
+
+void Tracing::clear()
+{
+  gEpoch.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,103 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <atomic>
+
+class QIODevice;
+
+// Span recording in the Chrome trace event format, for loading into
+// chrome://tracing or Perfetto.
+//
+// The CMK_TRACE_* macros compile to nothing unless the build enables
+// CMAKEKATE_TRACING.  When compiled in, recording is switched on at runtime
+// with Tracing::setEnabled() and a disabled span costs one relaxed load.
+// Every thread appends to its own ring buffer without locking; names and
+// categories must be string literals.
+namespace Tracing
+{
+  extern std::atomic<bool> gEnabled;
+
+  inline bool isEnabled()
+  {
+    return gEnabled.load(std::memory_order_relaxed);
+  }
+
+  void setEnabled(bool enabled);
+
+  qint64 nowUs();
+  void recordSpan(const char* category, const char* name,
+                  qint64 startUs, qint64 durationUs);
+  void recordInstant(const char* category, const char* name);
+
+  // Writes the recorded events of all threads as trace JSON.
+  void writeChromeTrace(QIODevice* device);
+  // Drops the recorded events.  Safe while other threads record: each
+  // thread empties its own buffer when it next records.
+  void clear();
+
+  class Scope
+  {
+  public:
+    Scope(const char* category, const char* name)
+      : mCategory(category), mName(name),
+        mStartUs(isEnabled() ? nowUs() : -1)
+    {
+    }
+
+    ~Scope()
+    {
+      if (mStartUs >= 0)
+        {
+          recordSpan(mCategory, mName, mStartUs, nowUs() - mStartUs);
+        }
+    }
+
+  private:
+    Q_DISABLE_COPY(Scope)
+
+    const char* mCategory;
+    const char* mName;
+    qint64 mStartUs;
+  };
+}
+
+#ifdef CMAKEKATE_TRACING
+
+#define CMK_TRACE_CONCAT_IMPL(A, B) A ## B
+#define CMK_TRACE_CONCAT(A, B) CMK_TRACE_CONCAT_IMPL(A, B)
+
+#define CMK_TRACE_SCOPE(CATEGORY, NAME) \
+  Tracing::Scope CMK_TRACE_CONCAT(cmkTraceScope, __LINE__)(CATEGORY, NAME)
+
+#define CMK_TRACE_INSTANT(CATEGORY, NAME) \
+  do { \
+    if (Tracing::isEnabled()) \
+      Tracing::recordInstant(CATEGORY, NAME); \
+  } while (0)
+
+#else
+
+#define CMK_TRACE_SCOPE(CATEGORY, NAME) do { } while (0)
+#define CMK_TRACE_INSTANT(CATEGORY, NAME) do { } while (0)
+
+#endif
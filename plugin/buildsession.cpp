@@ -0,0 +1,86 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "buildsession.h"
+
+#include "cmakeclient.h"
+#include "compileflagsindex.h"
+#include "completionindex.h"
+#include "projectmodel.h"
+#include "projectsnapshot.h"
+
+BuildSession::BuildSession(QObject* parent)
+  : QObject(parent)
+{
+  mClient = new CMakeClient(this);
+  mClient->setRecorder(&mRecorder);
+  mSnapshotUpdater = new ProjectSnapshotUpdater(mClient, this);
+  mCompletionIndex = new CompletionIndex(mClient, this);
+  mProjectModel = new ProjectModel(mClient, this);
+
+  connect(mClient, &CMakeClient::targetsRetrieved, this,
+          [this](QStringList const&, QVector<CMakeTarget> const& targets) {
+      mTargetGraph.build(targets);
+    });
+
+  mCompileFlagsIndex = new CompileFlagsIndex(mClient, this);
+  connect(mProjectModel, &ProjectModel::configsChanged, this, [this] {
+      mCompileFlagsIndex->setConfig(mProjectModel->config());
+    });
+}
+
+BuildSession::~BuildSession()
+{
+  mClient->setRecorder(nullptr);
+}
+
+CMakeClient* BuildSession::client() const
+{
+  return mClient;
+}
+
+CompileFlagsIndex* BuildSession::compileFlagsIndex() const
+{
+  return mCompileFlagsIndex;
+}
+
+CompletionIndex* BuildSession::completionIndex() const
+{
+  return mCompletionIndex;
+}
+
+ProjectModel* BuildSession::projectModel() const
+{
+  return mProjectModel;
+}
+
+ProtocolRecorder* BuildSession::recorder()
+{
+  return &mRecorder;
+}
+
+const TargetGraph& BuildSession::targetGraph() const
+{
+  return mTargetGraph;
+}
+
+QString BuildSession::buildDir() const
+{
+  return mBuildDir;
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (c) 2016 Stephen Kelly <steveire@gmail.com>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#pragma once
+
+#include "protocolrecorder.h"
+#include "targetgraph.h"
+
+#include <QObject>
+
+class CMakeClient;
+class CompileFlagsIndex;
+class CompletionIndex;
+class ProjectModel;
+class ProjectSnapshotUpdater;
+
+// The daemon of one build directory together with everything derived from
+// its replies.  Sessions are handed out by CMakeKatePlugin and shared by
+// all main windows which have the build open.
+class BuildSession : public QObject
+{
+  Q_OBJECT
+public:
+  explicit BuildSession(QObject* parent = 0);
+  ~BuildSession();
+
+  CMakeClient* client() const;
+  CompileFlagsIndex* compileFlagsIndex() const;
+  CompletionIndex* completionIndex() const;
+  ProjectModel* projectModel() const;
+  ProtocolRecorder* recorder();
+  const TargetGraph& targetGraph() const;
+
+  // The canonical build directory, empty for an offline session.
+  QString buildDir() const;
+
+private:
+  friend class CMakeKatePlugin;
+
+  ProtocolRecorder mRecorder;
+  TargetGraph mTargetGraph;
+  CMakeClient* mClient;
+  CompileFlagsIndex* mCompileFlagsIndex;
+  CompletionIndex* mCompletionIndex;
+  ProjectModel* mProjectModel;
+  ProjectSnapshotUpdater* mSnapshotUpdater;
+  QString mBuildDir;
+  int mRefCount = 0;
+};
@@ -19,6 +19,10 @@
 
 #include "cmakekateplugin.h"
 #include "cmakekatewindowintegration.h"
+#include "buildsession.h"
+#include "cmakeclient.h"
+#include "projectmodel.h"
+#include "projectsnapshot.h"
 
 #include <KConfigGroup>
 #include <KDirWatch>
@@ -27,6 +31,8 @@
 
 #include <QDir>
 #include <QDebug>
+#include <QFileInfo>
+#include <QTimer>
 
 K_PLUGIN_FACTORY_WITH_JSON(CMakeKatePluginFactory,
                            "cmakekateplugin.json",
@@ -34,7 +40,29 @@ K_PLUGIN_FACTORY_WITH_JSON(CMakeKatePluginFactory,
 
 CMakeKatePlugin::CMakeKatePlugin(QObject *parent, const QList<QVariant> &)
     : KTextEditor::Plugin(parent)
+    , mStandby(nullptr)
 {
+    // Have the last used build configured by the time it is opened again.
+    KConfigGroup config(KSharedConfig::openConfig(), "CMakeKate");
+    auto lastBuildDir = QFileInfo(config.readEntry("LastBuildDir", QString()))
+                            .canonicalFilePath();
+    if (!lastBuildDir.isEmpty())
+    {
+        mStandby = new BuildSession(this);
+        mStandby->mBuildDir = lastBuildDir;
+        mStandby->client()->prestart(cmakeExecutable(), lastBuildDir);
+
+        // A build which is not opened again holds its memory no longer
+        // than an idle session would.
+        auto hibernateMinutes = config.readEntry("HibernateAfterMinutes", 30);
+        if (hibernateMinutes > 0)
+        {
+            QTimer::singleShot(hibernateMinutes * 60 * 1000, this, [this] {
+                delete mStandby;
+                mStandby = nullptr;
+            });
+        }
+    }
 }
 
 CMakeKatePlugin::~CMakeKatePlugin()
@@ -46,4 +74,75 @@ QObject *CMakeKatePlugin::createView(KTextEditor::MainWindow *mainWindow)
     return new CMakeKateWindowIntegration(this, mainWindow);
 }
 
+QString CMakeKatePlugin::cmakeExecutable()
+{
+    return QStringLiteral("/home/stephen/dev/prefix/qt/kde/bin/cmake");
+}
+
+BuildSession *CMakeKatePlugin::acquireSession(const QString &buildDir)
+{
+    if (buildDir.isEmpty())
+    {
+        auto session = new BuildSession(this);
+        session->mRefCount = 1;
+        session->client()->startOffline();
+        return session;
+    }
+
+    auto key = QFileInfo(buildDir).canonicalFilePath();
+    if (key.isEmpty())
+    {
+        key = QDir::cleanPath(buildDir);
+    }
+    if (auto session = mSessions.value(key))
+    {
+        ++session->mRefCount;
+        return session;
+    }
+
+    BuildSession *session;
+    if (mStandby && mStandby->buildDir() == key)
+    {
+        session = mStandby;
+        mStandby = nullptr;
+    }
+    else
+    {
+        // The warm daemon is for another build; it will not be used now.
+        delete mStandby;
+        mStandby = nullptr;
+        session = new BuildSession(this);
+        session->mBuildDir = key;
+    }
+    session->mRefCount = 1;
+    mSessions.insert(key, session);
+
+    ProjectSnapshot snapshot;
+    if (snapshot.load(ProjectSnapshot::fileNameFor(key)))
+    {
+        session->projectModel()->loadSnapshot(snapshot);
+    }
+
+    KConfigGroup config(KSharedConfig::openConfig(), "CMakeKate");
+    config.writeEntry("LastBuildDir", key);
+
+    // An idle configured daemon holds a lot of memory; let it go and bring
+    // it back when the build is queried again.
+    auto hibernateMinutes = config.readEntry("HibernateAfterMinutes", 30);
+    session->client()->setHibernateTimeout(hibernateMinutes * 60 * 1000);
+
+    session->client()->start(cmakeExecutable(), key);
+    return session;
+}
+
+void CMakeKatePlugin::releaseSession(BuildSession *session)
+{
+    if (--session->mRefCount > 0)
+    {
+        return;
+    }
+    mSessions.remove(session->buildDir());
+    session->deleteLater();
+}
+
 #include "cmakekateplugin.moc"
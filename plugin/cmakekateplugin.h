@@ -20,11 +20,14 @@
 #ifndef CMAKEKATEPLUGIN_H
 #define CMAKEKATEPLUGIN_H
 
+#include <QHash>
 #include <QUrl>
 #include <QVariant>
 
 #include <KTextEditor/Plugin>
 
+class BuildSession;
+
 class CMakeKatePlugin : public KTextEditor::Plugin
 {
     Q_OBJECT
@@ -34,6 +37,18 @@ class CMakeKatePlugin : public KTextEditor::Plugin
         virtual ~CMakeKatePlugin();
 
         QObject *createView(KTextEditor::MainWindow *mainWindow);
+
+        // Returns the session of a build directory, starting its daemon if
+        // no window has the build open yet.  An empty buildDir gives an
+        // unshared offline session for replaying recordings.
+        BuildSession *acquireSession(const QString &buildDir);
+        void releaseSession(BuildSession *session);
+
+        static QString cmakeExecutable();
+
+    private:
+        QHash<QString, BuildSession*> mSessions;
+        BuildSession *mStandby;
 };
 
 #endif
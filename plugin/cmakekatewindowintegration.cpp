@@ -18,19 +18,35 @@
 */
 
 #include "cmakekatewindowintegration.h"
+#include "cmakekateplugin.h"
+#include "buildrunner.h"
+#include "buildsession.h"
 
 #include "cmakeclient.h"
+#include "compileflagsindex.h"
+#include "completionindex.h"
+#include "completionmodel.h"
+#include "helpprovider.h"
 #include "projectmodel.h"
+#include "targetgraph.h"
 #include "debugwidget.h"
+#include "protocolreplay.h"
+#include "statswidget.h"
+#include "tracing.h"
 
 #include <ktexteditor/plugin.h>
 #include <ktexteditor/mainwindow.h>
 #include <ktexteditor/application.h>
 #include <ktexteditor/document.h>
 #include <ktexteditor/view.h>
+#include <ktexteditor/codecompletioninterface.h>
+#include <ktexteditor/texthintinterface.h>
 
 #include <QAction>
+#include <QComboBox>
+#include <QMessageBox>
 #include <QTreeView>
+#include <QTreeWidget>
 #include <QStringListModel>
 #include <kactioncollection.h>
 #include <klocalizedstring.h>
@@ -45,11 +61,24 @@
 #include <QVBoxLayout>
 #include <QApplication>
 #include <QFileDialog>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
 
-CMakeKateWindowIntegration::CMakeKateWindowIntegration(KTextEditor::Plugin *plugin, KTextEditor::MainWindow *mw)
+CMakeKateWindowIntegration::CMakeKateWindowIntegration(CMakeKatePlugin *plugin, KTextEditor::MainWindow *mw)
 : QObject (mw)
 , KXMLGUIClient()
 , m_mainWindow(mw)
+, mSession(nullptr)
+, mCompletionModel(nullptr)
+, mHelpProvider(nullptr)
+, mConfigCombo(nullptr)
+, mProjectTree(nullptr)
+, mDependentsView(nullptr)
+, mDebugWidget(nullptr)
+, mStatsWidget(nullptr)
+, mDiagnosticsView(nullptr)
 , m_plugin(plugin)
 {
   KXMLGUIClient::setComponentName (QLatin1String("cmakekate"), i18n ("CMake Kate Plugin"));
@@ -58,13 +87,156 @@ CMakeKateWindowIntegration::CMakeKateWindowIntegration(KTextEditor::Plugin *plug
   auto a = actionCollection()->addAction(QStringLiteral("cmake_open_build"), this, SLOT(openBuildDialog()));
   a->setText(i18n("Open CMake Build"));
 
-  mClient = new CMakeClient(this);
+#ifdef CMAKEKATE_TRACING
+  auto traceAction = actionCollection()->addAction(QStringLiteral("cmake_trace_record"));
+  traceAction->setText(i18n("Record CMake Trace"));
+  traceAction->setCheckable(true);
+  connect(traceAction, &QAction::toggled, [](bool on) {
+      if (on)
+        {
+          Tracing::clear();
+        }
+      Tracing::setEnabled(on);
+    });
+
+  auto saveTraceAction = actionCollection()->addAction(QStringLiteral("cmake_trace_save"));
+  saveTraceAction->setText(i18n("Save CMake Trace..."));
+  connect(saveTraceAction, &QAction::triggered, [] {
+      auto fileName = QFileDialog::getSaveFileName(
+            nullptr, i18n("Save CMake Trace"), QString(),
+            QStringLiteral("Trace (*.json)"));
+      if (fileName.isEmpty())
+        {
+          return;
+        }
+      QFile file(fileName);
+      if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+          Tracing::writeChromeTrace(&file);
+        }
+    });
+#endif
+
+  auto saveRecordingAction = actionCollection()->addAction(QStringLiteral("cmake_recording_save"));
+  saveRecordingAction->setText(i18n("Save CMake Protocol Recording..."));
+  connect(saveRecordingAction, &QAction::triggered, this, [this] {
+      auto fileName = QFileDialog::getSaveFileName(
+            nullptr, i18n("Save CMake Protocol Recording"), QString(),
+            QStringLiteral("Recording (*.cmkrec)"));
+      if (fileName.isEmpty())
+        {
+          return;
+        }
+      QFile file(fileName);
+      if (mSession && file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+          mSession->recorder()->dump(&file);
+        }
+    });
+
+  auto exportAction = actionCollection()->addAction(QStringLiteral("cmake_export_compile_commands"));
+  exportAction->setText(i18n("Write compile_commands.json"));
+  connect(exportAction, &QAction::triggered, this, [this] {
+      if (!mSession || mSession->buildDir().isEmpty())
+        {
+          return;
+        }
+      QSaveFile file(mSession->buildDir() + QStringLiteral("/compile_commands.json"));
+      if (!file.open(QIODevice::WriteOnly)
+          || !mSession->compileFlagsIndex()->writeCompileCommands(&file)
+          || !file.commit())
+        {
+          QMessageBox::warning(m_mainWindow->window(),
+                               i18n("Write compile_commands.json"),
+                               i18n("Could not write %1: %2",
+                                    file.fileName(), file.errorString()));
+        }
+    });
+
+  auto buildAction = actionCollection()->addAction(QStringLiteral("cmake_build_modified"), this, SLOT(buildModified()));
+  buildAction->setText(i18n("Build Targets Affected by Modified Files"));
+
+  mBuildRunner = new BuildRunner(this);
+  connect(mBuildRunner, &BuildRunner::diagnosticAdded,
+          this, &CMakeKateWindowIntegration::showDiagnostic);
+  connect(mBuildRunner, &BuildRunner::finished, this, [this](bool success) {
+      if (success)
+        {
+          mSavedSinceBuild.subtract(mSavedForBuild);
+        }
+      mSavedForBuild.clear();
+      new QTreeWidgetItem(mDiagnosticsView, QStringList()
+          << QString() << QString()
+          << (success ? i18n("Build succeeded") : i18n("Build failed")));
+    });
+
+  auto replayAction = actionCollection()->addAction(QStringLiteral("cmake_recording_replay"), this, SLOT(replayRecordingDialog()));
+  replayAction->setText(i18n("Replay CMake Protocol Recording..."));
+
+  connect(m_mainWindow, &KTextEditor::MainWindow::viewCreated,
+          this, &CMakeKateWindowIntegration::registerView);
+  connect(m_mainWindow, &KTextEditor::MainWindow::viewChanged,
+          this, [this](KTextEditor::View* view) {
+      if (mHelpProvider)
+        {
+          mHelpProvider->setView(view);
+        }
+      revealDocument(view);
+    });
 
   m_mainWindow->guiFactory()->addClient(this);
 }
 
+void CMakeKateWindowIntegration::registerView(KTextEditor::View* view)
+{
+  connect(view->document(), &KTextEditor::Document::documentSavedOrUploaded,
+          this, &CMakeKateWindowIntegration::documentSaved,
+          Qt::UniqueConnection);
+  if (!mSession)
+    {
+      return;
+    }
+  auto cci = qobject_cast<KTextEditor::CodeCompletionInterface*>(view);
+  if (cci)
+    {
+      cci->registerCompletionModel(mCompletionModel);
+    }
+  auto thi = qobject_cast<KTextEditor::TextHintInterface*>(view);
+  if (thi)
+    {
+      thi->registerTextHintProvider(mHelpProvider);
+    }
+}
+
 void CMakeKateWindowIntegration::openBuild(QString const& buildDir)
 {
+//   connect(mClient, &CMakeClient::stdoutReceieved, this,
+//           [this](const QString& newBit) {
+//       qDebug() << "INCOMING" << newBit;
+//     });
+//
+//   connect(mClient, &CMakeClient::stdinWritten, this,
+//           [this](const QString& newBit) {
+//       qDebug() << "OUTGOING" << newBit;
+//     });
+
+  auto session = m_plugin->acquireSession(buildDir);
+  if (session == mSession)
+    {
+      m_plugin->releaseSession(session);
+      return;
+    }
+  detachSession();
+  attachSession(session);
+}
+
+void CMakeKateWindowIntegration::createToolViews()
+{
+  if (mProjectTree)
+    {
+      return;
+    }
+
   m_projectToolView = m_mainWindow->createToolView(m_plugin,
         QLatin1String ("kate_private_plugin_cmake_project"),
         KTextEditor::MainWindow::Left,
@@ -79,30 +251,222 @@ void CMakeKateWindowIntegration::openBuild(QString const& buildDir)
         i18nc("@title:window", "CMake State")
   );
 
-//   connect(mClient, &CMakeClient::stdoutReceieved, this,
-//           [this](const QString& newBit) {
-//       qDebug() << "INCOMING" << newBit;
-//     });
-//
-//   connect(mClient, &CMakeClient::stdinWritten, this,
-//           [this](const QString& newBit) {
-//       qDebug() << "OUTGOING" << newBit;
-//     });
-
-  mClient->start("/home/stephen/dev/prefix/qt/kde/bin/cmake", buildDir);
+  m_statsToolView = m_mainWindow->createToolView(m_plugin,
+        QLatin1String ("kate_private_plugin_cmake_stats"),
+        KTextEditor::MainWindow::Bottom,
+        QIcon::fromTheme (QLatin1String ("view-statistics")),
+        i18nc("@title:window", "CMake Statistics")
+  );
 
   m_mainWindow->showToolView(m_projectToolView);
   m_mainWindow->showToolView(m_stateBrowserToolView);
 
-  auto projectTree = new QTreeView(m_projectToolView);
-  mProjectModel = new ProjectModel(mClient, this);
-  projectTree->setModel(mProjectModel);
+  mConfigCombo = new QComboBox(m_projectToolView);
+  connect(mConfigCombo, SELECT<const QString&>::OVERLOAD_OF(&QComboBox::activated),
+          this, [this](const QString& config) {
+      if (mSession)
+        {
+          mSession->projectModel()->setConfig(config);
+        }
+    });
+
+  mProjectTree = new QTreeView(m_projectToolView);
+
+  m_buildToolView = m_mainWindow->createToolView(m_plugin,
+        QLatin1String ("kate_private_plugin_cmake_build"),
+        KTextEditor::MainWindow::Bottom,
+        QIcon::fromTheme (QLatin1String ("run-build")),
+        i18nc("@title:window", "CMake Build")
+  );
 
-  connect(mProjectModel, &QAbstractItemModel::modelReset, this, [this, projectTree]{
-      projectTree->expandAll();
+  mDiagnosticsView = new QTreeWidget(m_buildToolView);
+  mDiagnosticsView->setHeaderLabels(QStringList()
+      << i18n("File") << i18n("Line") << i18n("Message"));
+  mDiagnosticsView->setRootIsDecorated(false);
+  connect(mDiagnosticsView, &QTreeWidget::itemActivated,
+          this, [this](QTreeWidgetItem* item) {
+      auto file = item->data(0, Qt::UserRole).toString();
+      if (file.isEmpty())
+        {
+          return;
+        }
+      auto view = m_mainWindow->openUrl(QUrl::fromLocalFile(file));
+      if (view)
+        {
+          view->setCursorPosition(KTextEditor::Cursor(
+              item->data(1, Qt::UserRole).toInt() - 1, 0));
+        }
     });
 
-  connect(projectTree->selectionModel(), &QItemSelectionModel::selectionChanged,
+  mDependentsView = new QTreeWidget(m_projectToolView);
+  mDependentsView->setHeaderLabels(QStringList(i18n("Dependents")));
+  mDependentsView->setRootIsDecorated(false);
+}
+
+void CMakeKateWindowIntegration::documentSaved(KTextEditor::Document* document)
+{
+  auto path = document->url().toLocalFile();
+  mSavedSinceBuild.insert(path);
+  // Saved again after the build read it.
+  mSavedForBuild.remove(path);
+}
+
+void CMakeKateWindowIntegration::buildModified()
+{
+  if (!mSession || mSession->buildDir().isEmpty())
+    {
+      return;
+    }
+
+  auto changed = mSavedSinceBuild;
+  foreach (auto view, m_mainWindow->views())
+    {
+      if (view->document()->isModified())
+        {
+          changed.insert(view->document()->url().toLocalFile());
+        }
+    }
+
+  QStringList owners;
+  for (auto const& path : changed)
+    {
+      owners += mSession->projectModel()->targetsForSource(path);
+    }
+  auto targets = BuildRunner::minimalTargets(mSession->targetGraph(), owners);
+  if (targets.isEmpty())
+    {
+      return;
+    }
+
+  createToolViews();
+  m_mainWindow->showToolView(m_buildToolView);
+  mDiagnosticsView->clear();
+
+  KConfigGroup config(KSharedConfig::openConfig(), "CMakeKate");
+  mBuildRunner->setJobs(config.readEntry("BuildJobs", QThread::idealThreadCount()));
+  if (!mBuildRunner->start(mSession->buildDir(), targets))
+    {
+      new QTreeWidgetItem(mDiagnosticsView, QStringList()
+          << QString() << QString()
+          << i18n("No build.ninja or Makefile in %1", mSession->buildDir()));
+      return;
+    }
+  mSavedForBuild = mSavedSinceBuild;
+}
+
+void CMakeKateWindowIntegration::showDiagnostic(int index)
+{
+  auto const& diagnostic = mBuildRunner->diagnostics().at(index);
+  auto item = new QTreeWidgetItem(mDiagnosticsView, QStringList()
+      << QFileInfo(diagnostic.File).fileName()
+      << QString::number(diagnostic.Line)
+      << diagnostic.Message);
+  item->setData(0, Qt::UserRole, diagnostic.File);
+  item->setData(1, Qt::UserRole, diagnostic.Line);
+  item->setToolTip(0, diagnostic.File);
+  if (diagnostic.Kind == BuildRunner::Error)
+    {
+      item->setIcon(0, QIcon::fromTheme(QStringLiteral("dialog-error")));
+    }
+  else if (diagnostic.Kind == BuildRunner::Warning)
+    {
+      item->setIcon(0, QIcon::fromTheme(QStringLiteral("dialog-warning")));
+    }
+}
+
+void CMakeKateWindowIntegration::showDependents(const QModelIndex& index)
+{
+  mDependentsView->clear();
+  if (!mSession)
+    {
+      return;
+    }
+  auto target = index.data(ProjectModel::TargetName).toString();
+  if (target.isEmpty())
+    {
+      target = index.parent().data(ProjectModel::TargetName).toString();
+    }
+  auto dependents = mSession->targetGraph().transitiveDependents(target);
+  dependents.sort();
+  for (auto const& dependent : dependents)
+    {
+      new QTreeWidgetItem(mDependentsView, QStringList(dependent));
+    }
+}
+
+void CMakeKateWindowIntegration::revealDocument(KTextEditor::View* view)
+{
+  if (!mSession || !view)
+    {
+      return;
+    }
+  auto path = view->document()->url().toLocalFile();
+  auto projectModel = mSession->projectModel();
+  auto idx = projectModel->indexForSource(path);
+  if (!idx.isValid())
+    {
+      return;
+    }
+  mProjectTree->scrollTo(idx);
+  mProjectTree->selectionModel()->setCurrentIndex(idx,
+                                                  QItemSelectionModel::NoUpdate);
+
+  auto target = projectModel->targetsForSource(path).value(0);
+  auto flags = mSession->compileFlagsIndex()->flagsForTarget(target);
+  if (flags)
+    {
+      mDebugWidget->setTarget(target, flags->IncludeDirectories,
+                              flags->CompileDefinitions);
+    }
+}
+
+void CMakeKateWindowIntegration::updateConfigs()
+{
+  auto projectModel = mSession->projectModel();
+  mConfigCombo->clear();
+  mConfigCombo->addItems(projectModel->configs());
+  mConfigCombo->setCurrentIndex(
+        projectModel->configs().indexOf(projectModel->config()));
+  mConfigCombo->setVisible(projectModel->configs().size() > 1);
+}
+
+void CMakeKateWindowIntegration::attachSession(BuildSession* session)
+{
+  mSession = session;
+  auto client = mSession->client();
+
+  createToolViews();
+
+  mCompletionModel = new CompletionModel(client, mSession->completionIndex(),
+                                         this);
+  mHelpProvider = new HelpProvider(client, this);
+  foreach (auto view, m_mainWindow->views())
+    {
+      registerView(view);
+    }
+  mHelpProvider->setView(m_mainWindow->activeView());
+
+  auto projectModel = mSession->projectModel();
+  auto oldSelectionModel = mProjectTree->selectionModel();
+  mProjectTree->setModel(projectModel);
+  delete oldSelectionModel;
+  mProjectTree->expandAll();
+
+  updateConfigs();
+  connect(projectModel, &ProjectModel::configsChanged,
+          mConfigCombo, [this] { updateConfigs(); });
+
+  connect(projectModel, &QAbstractItemModel::modelReset, mProjectTree, [this]{
+      CMK_TRACE_SCOPE("view", "expandAll");
+      mProjectTree->expandAll();
+    });
+
+  connect(mProjectTree->selectionModel(), &QItemSelectionModel::currentChanged,
+          this, [this](const QModelIndex& current) {
+      showDependents(current);
+    });
+
+  connect(mProjectTree->selectionModel(), &QItemSelectionModel::selectionChanged,
           [this] (const QItemSelection& selected){
     auto idxs = selected.indexes();
     if (idxs.size() == 1) {
@@ -112,7 +476,79 @@ void CMakeKateWindowIntegration::openBuild(QString const& buildDir)
     }
   });
 
-  mDebugWidget = new DebugWidget(mClient, m_stateBrowserToolView);
+  mDebugWidget = new DebugWidget(client, m_stateBrowserToolView);
+  mDebugWidget->show();
+
+  mStatsWidget = new StatsWidget(client, m_statsToolView);
+  mStatsWidget->show();
+
+  revealDocument(m_mainWindow->activeView());
+}
+
+void CMakeKateWindowIntegration::detachSession()
+{
+  if (!mSession)
+    {
+      return;
+    }
+
+  foreach (auto view, m_mainWindow->views())
+    {
+      auto cci = qobject_cast<KTextEditor::CodeCompletionInterface*>(view);
+      if (cci)
+        {
+          cci->unregisterCompletionModel(mCompletionModel);
+        }
+      auto thi = qobject_cast<KTextEditor::TextHintInterface*>(view);
+      if (thi)
+        {
+          thi->unregisterTextHintProvider(mHelpProvider);
+        }
+    }
+  delete mCompletionModel;
+  mCompletionModel = nullptr;
+  delete mHelpProvider;
+  mHelpProvider = nullptr;
+  delete mDebugWidget;
+  mDebugWidget = nullptr;
+  delete mStatsWidget;
+  mStatsWidget = nullptr;
+
+  disconnect(mSession->projectModel(), nullptr, mProjectTree, nullptr);
+  disconnect(mSession->projectModel(), nullptr, mConfigCombo, nullptr);
+  mConfigCombo->clear();
+  auto oldSelectionModel = mProjectTree->selectionModel();
+  mProjectTree->setModel(nullptr);
+  delete oldSelectionModel;
+  mDependentsView->clear();
+
+  m_plugin->releaseSession(mSession);
+  mSession = nullptr;
+}
+
+void CMakeKateWindowIntegration::replayRecordingDialog()
+{
+  auto fileName = QFileDialog::getOpenFileName(
+        nullptr, i18n("Replay CMake Protocol Recording"), QString(),
+        QStringLiteral("Recording (*.cmkrec)"));
+  if (fileName.isEmpty())
+    {
+      return;
+    }
+
+  QFile file(fileName);
+  auto replay = new ProtocolReplay(this);
+  if (!file.open(QIODevice::ReadOnly) || !replay->load(&file))
+    {
+      delete replay;
+      return;
+    }
+
+  detachSession();
+  attachSession(m_plugin->acquireSession(QString()));
+  replay->setParent(mSession);
+  connect(replay, &ProtocolReplay::finished, replay, &QObject::deleteLater);
+  replay->start(mSession->client(), ProtocolReplay::OriginalSpeed);
 }
 
 void CMakeKateWindowIntegration::openBuildDialog()
@@ -135,4 +571,5 @@ void CMakeKateWindowIntegration::openBuildDialog()
 
 CMakeKateWindowIntegration::~CMakeKateWindowIntegration()
 {
+  detachSession();
 }
@@ -20,43 +20,74 @@
 #ifndef CMakeKateVIEW_H
 #define CMakeKateVIEW_H
 
+class BuildRunner;
+class BuildSession;
+class CMakeKatePlugin;
 class DebugWidget;
-class CMakeClient;
-class QAbstractItemModel;
+class CompletionModel;
+class HelpProvider;
+class StatsWidget;
 class QSqlQuery;
 class QActionGroup;
+class QComboBox;
+class QModelIndex;
+class QTreeView;
+class QTreeWidget;
 
 #include <KXMLGUIClient>
 
-#include <ktexteditor/mainwindow.h>
+#include <QSet>
 
-namespace KTextEditor
-{
-  class Plugin;
-}
+#include <ktexteditor/mainwindow.h>
 
 class CMakeKateWindowIntegration : public QObject, public KXMLGUIClient
 {
   Q_OBJECT
 
 public:
-    CMakeKateWindowIntegration(KTextEditor::Plugin *plugin,
+    CMakeKateWindowIntegration(CMakeKatePlugin *plugin,
                                 KTextEditor::MainWindow *mw);
     ~CMakeKateWindowIntegration();
 
 private Q_SLOTS:
     void openBuild(QString const& buildDir);
     void openBuildDialog();
+    void replayRecordingDialog();
+    void registerView(KTextEditor::View* view);
+    void buildModified();
+    void documentSaved(KTextEditor::Document* document);
+
+private:
+    void createToolViews();
+    void attachSession(BuildSession* session);
+    void detachSession();
+    void updateConfigs();
+    void revealDocument(KTextEditor::View* view);
+    void showDependents(const QModelIndex& index);
+    void showDiagnostic(int index);
 
 private:
     KTextEditor::MainWindow *m_mainWindow;
-    CMakeClient* mClient;
-    QAbstractItemModel* mProjectModel;
+    BuildSession* mSession;
+    CompletionModel* mCompletionModel;
+    HelpProvider* mHelpProvider;
+    QComboBox* mConfigCombo;
+    QTreeView* mProjectTree;
+    QTreeWidget* mDependentsView;
     DebugWidget* mDebugWidget;
+    StatsWidget* mStatsWidget;
+    BuildRunner* mBuildRunner;
+    QTreeWidget* mDiagnosticsView;
+    // Documents saved since the last successful build.
+    QSet<QString> mSavedSinceBuild;
+    // Those of them the running build started with, and not saved since.
+    QSet<QString> mSavedForBuild;
 
     QWidget* m_projectToolView;
     QWidget* m_stateBrowserToolView;
-    KTextEditor::Plugin *m_plugin;
+    QWidget* m_statsToolView;
+    QWidget* m_buildToolView;
+    CMakeKatePlugin *m_plugin;
 };
 
 #endif // CMakeKateVIEW_H